@@ -0,0 +1,159 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Memory ballooning between Linux and the RT partition while enabled.
+ * Inflating allocates a contiguous range from the CMA area, which migrates
+ * the movable pages Linux keeps there, clears it and donates it to the RT
+ * partition. Deflating takes a range back and releases it to the area.
+ * The hypervisor keeps its root-cell and RT configuration in line.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#include <linux/highmem.h>
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+
+#include "balloon.h"
+#include "cma.h"
+#include "hypercall.h"
+
+struct balloon_range
+{
+	struct list_head list;
+	struct mem_region region;
+};
+
+/* Ranges given to the RT partition, newest first */
+static LIST_HEAD(balloon_ranges);
+static unsigned long long balloon_total;
+
+/* Neither side's data may leak to the other. */
+static void balloon_clear(const struct mem_region *region)
+{
+	unsigned long pfn = PHYS_PFN(region->start);
+	unsigned long end = PHYS_PFN(region->start + region->size);
+
+	for (; pfn < end; pfn++)
+	{
+		clear_highpage(pfn_to_page(pfn));
+		cond_resched();
+	}
+}
+
+static int balloon_inflate(struct jailhouse_balloon *balloon)
+{
+	struct balloon_range *range;
+	int err;
+
+	if (!balloon->size || !IS_ALIGNED(balloon->size, JAILHOUSE_BALLOON_ALIGN))
+		return -EINVAL;
+
+	range = kzalloc(sizeof(*range), GFP_KERNEL);
+	if (!range)
+		return -ENOMEM;
+	err = jailhouse_cma_alloc(
+		&range->region, balloon->size, JAILHOUSE_BALLOON_ALIGN);
+	if (err)
+		goto error_free;
+	balloon_clear(&range->region);
+
+	err = jailhouse_call_arg2(
+		JAILHOUSE_HC_MEM_DONATE, range->region.start, range->region.size);
+	if (err)
+	{
+		pr_err(
+			"jailhouse: donating [0x%llx-0x%llx] to the RT partition failed: "
+			"%d\n",
+			range->region.start,
+			range->region.start + range->region.size - 1, err);
+		jailhouse_cma_free(&range->region);
+		goto error_free;
+	}
+
+	list_add(&range->list, &balloon_ranges);
+	balloon_total += range->region.size;
+	balloon->start = range->region.start;
+	return 0;
+
+error_free:
+	kfree(range);
+	return err;
+}
+
+static int balloon_deflate(struct jailhouse_balloon *balloon)
+{
+	struct balloon_range *range;
+	int err;
+
+	list_for_each_entry(range, &balloon_ranges, list)
+		if (range->region.start == balloon->start)
+			goto found;
+	return -ENOENT;
+
+found:
+	/* fails while the RTOS still uses the range */
+	err = jailhouse_call_arg2(
+		JAILHOUSE_HC_MEM_RECLAIM, range->region.start, range->region.size);
+	if (err)
+		return err;
+
+	list_del(&range->list);
+	balloon_total -= range->region.size;
+	balloon->size = range->region.size;
+	balloon_clear(&range->region);
+	jailhouse_cma_free(&range->region);
+	kfree(range);
+	return 0;
+}
+
+/**
+ * Inflate or deflate the balloon as described by @c balloon and fill in
+ * its results. The caller holds jailhouse_lock with a hypervisor enabled
+ * that supports JAILHOUSE_HDR_MEM_BALLOON.
+ *
+ * @return 0 on success, -EOPNOTSUPP without CMA, -ENODEV without the CMA
+ * area, -ENOENT for an unknown range to deflate, negative error code
+ * otherwise.
+ */
+int jailhouse_balloon(struct jailhouse_balloon *balloon)
+{
+	int err;
+
+	switch (balloon->op)
+	{
+	case JAILHOUSE_BALLOON_INFLATE:
+		err = balloon_inflate(balloon);
+		break;
+	case JAILHOUSE_BALLOON_DEFLATE:
+		err = balloon_deflate(balloon);
+		break;
+	default:
+		err = -EINVAL;
+		break;
+	}
+	balloon->total = balloon_total;
+	return err;
+}
+
+/*
+ * Release all ranges to the CMA area without asking the hypervisor, once it
+ * has been left.
+ */
+void jailhouse_balloon_release(void)
+{
+	struct balloon_range *range, *next;
+
+	list_for_each_entry_safe(range, next, &balloon_ranges, list)
+	{
+		list_del(&range->list);
+		balloon_clear(&range->region);
+		jailhouse_cma_free(&range->region);
+		kfree(range);
+	}
+	balloon_total = 0;
+}
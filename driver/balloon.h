@@ -0,0 +1,9 @@
+#ifndef _JAILHOUSE_BALLOON_H
+#define _JAILHOUSE_BALLOON_H
+
+#include "jailhouse.h"
+
+int jailhouse_balloon(struct jailhouse_balloon *balloon);
+void jailhouse_balloon_release(void);
+
+#endif /* !_JAILHOUSE_BALLOON_H */
@@ -0,0 +1,127 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Hypercall latency microbenchmark.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#include <linux/bitops.h>
+#include <linux/irqflags.h>
+#include <linux/kernel.h>
+#include <linux/math64.h>
+#include <linux/mm.h>
+#include <linux/sort.h>
+#include <linux/string.h>
+#include <linux/workqueue.h>
+#include <asm/msr.h>
+
+#include "bench.h"
+#include "hypercall.h"
+
+struct bench_run
+{
+	const struct cpumask *cpus;
+	u64 *samples;
+	unsigned int iterations;
+	struct jailhouse_bench_cpu *result;
+};
+
+static int cmp_u64(const void *a, const void *b)
+{
+	u64 x = *(const u64 *)a, y = *(const u64 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Runs on the measured CPU, in process context. */
+static long bench_hypercall_cpu(void *arg)
+{
+	struct bench_run *run = arg;
+	struct jailhouse_bench_cpu *res = run->result;
+	unsigned long flags;
+	unsigned int n, bucket;
+	u64 t0, t1, sum = 0;
+
+	/*
+	 * The CPU may have left the hypervisor since it was picked, the
+	 * hotplug lock held by work_on_cpu_safe() keeps the mask stable now.
+	 */
+	if (!cpumask_test_cpu(smp_processor_id(), run->cpus))
+		return 0;
+
+	for (n = 0; n < run->iterations; n++)
+	{
+		local_irq_save(flags);
+		t0 = rdtsc_ordered();
+		jailhouse_call(JAILHOUSE_HC_NOP);
+		t1 = rdtsc_ordered();
+		local_irq_restore(flags);
+
+		run->samples[n] = t1 - t0;
+		if (!(n % 1024))
+			cond_resched();
+	}
+
+	memset(res, 0, sizeof(*res));
+	for (n = 0; n < run->iterations; n++)
+	{
+		sum += run->samples[n];
+		bucket = run->samples[n] ? fls64(run->samples[n]) - 1 : 0;
+		res->histogram[min_t(
+			unsigned int, bucket, JAILHOUSE_BENCH_BUCKETS - 1)]++;
+	}
+
+	sort(run->samples, run->iterations, sizeof(u64), cmp_u64, NULL);
+	res->min = run->samples[0];
+	res->max = run->samples[run->iterations - 1];
+	res->p99 = run->samples[(run->iterations - 1) * 99 / 100];
+	res->avg = div_u64(sum, run->iterations);
+	res->samples = run->iterations;
+
+	return 0;
+}
+
+/**
+ * Time null hypercalls on each online CPU of a mask, one CPU after the
+ * other so that they do not contend for the hypervisor.
+ * @param cpus		CPUs to measure. May change during the run under the
+ *			CPU hotplug lock, CPUs are checked again before
+ *			being measured.
+ * @param iterations	Calls per CPU, 1..JAILHOUSE_BENCH_MAX_ITERATIONS.
+ * @param results	Output, indexed by CPU number. Entries of CPUs not
+ *			measured have samples set to 0.
+ * @param num_results	Number of entries in @c results.
+ *
+ * @return 0 on success, negative error code otherwise.
+ */
+int jailhouse_bench_hypercall(
+	const struct cpumask *cpus, unsigned int iterations,
+	struct jailhouse_bench_cpu *results, unsigned int num_results)
+{
+	struct bench_run run;
+	unsigned int cpu;
+
+	if (!iterations || iterations > JAILHOUSE_BENCH_MAX_ITERATIONS)
+		return -EINVAL;
+
+	run.samples = kvmalloc_array(iterations, sizeof(u64), GFP_KERNEL);
+	if (!run.samples)
+		return -ENOMEM;
+	run.iterations = iterations;
+	run.cpus = cpus;
+
+	memset(results, 0, num_results * sizeof(*results));
+	for_each_cpu(cpu, cpus)
+	{
+		if (cpu >= num_results)
+			break;
+		/* skips offline CPUs, their samples stay 0 */
+		run.result = &results[cpu];
+		work_on_cpu_safe(cpu, bench_hypercall_cpu, &run);
+	}
+
+	kvfree(run.samples);
+	return 0;
+}
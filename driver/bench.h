@@ -0,0 +1,12 @@
+#ifndef _JAILHOUSE_BENCH_H
+#define _JAILHOUSE_BENCH_H
+
+#include <linux/cpumask.h>
+
+#include "jailhouse.h"
+
+int jailhouse_bench_hypercall(
+	const struct cpumask *cpus, unsigned int iterations,
+	struct jailhouse_bench_cpu *results, unsigned int num_results);
+
+#endif /* !_JAILHOUSE_BENCH_H */
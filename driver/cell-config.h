@@ -9,7 +9,7 @@
  * Incremented on any layout or semantic change of system or cell config.
  * Also update formats and HEADER_REVISION in pyjailhouse/config_parser.py.
  */
-#define JAILHOUSE_CONFIG_REVISION 13
+#define JAILHOUSE_CONFIG_REVISION 14
 
 #define JAILHOUSE_CELL_NAME_MAXLEN 31
 
@@ -41,6 +41,12 @@ struct jailhouse_cell_desc
 #define JAILHOUSE_MEM_DMA 0x0008
 #define JAILHOUSE_MEM_IO 0x0010
 #define JAILHOUSE_MEM_NO_HUGEPAGES 0x0100
+/* Page size hints: the region consists of whole, aligned pages of this
+ * size. Set by the driver's layout optimizer, which counts the stage-2
+ * entries with them; the hypervisor maps the region with that page size
+ * without checking its alignment again, or may ignore them. */
+#define JAILHOUSE_MEM_HINT_2M 0x0200
+#define JAILHOUSE_MEM_HINT_1G 0x0400
 
 struct jailhouse_memory
 {
@@ -50,6 +56,22 @@ struct jailhouse_memory
 	__u64 flags;
 } __attribute__((packed));
 
+/**
+ * A NUMA node, indexed by the node ID of Linux.
+ */
+struct jailhouse_numa_node
+{
+	/** Span of the node's memory, may contain holes. 0 if the node has
+	 * no memory. */
+	__u64 mem_start;
+	__u64 mem_size;
+	/** Memory holding the per-CPU areas of the node's CPUs in ascending
+	 * CPU order, allocated by the driver from the root cell's memory. 0
+	 * if they are behind the hypervisor core as usual. */
+	__u64 percpu_start;
+	__u64 percpu_size;
+} __attribute__((packed));
+
 /**
  * General descriptor of the system.
  */
@@ -61,6 +83,10 @@ struct jailhouse_system
 	/** Jailhouse's location in memory */
 	struct jailhouse_memory hypervisor_memory;
 	struct jailhouse_memory rtos_memory;
+	/** Entries of the NUMA node table and of the CPU-to-node table that
+	 * follow the root cell's memory regions in this order. */
+	__u32 num_numa_nodes;
+	__u32 num_cpus;
 	struct jailhouse_cell_desc root_cell;
 } __attribute__((packed));
 
@@ -75,7 +101,9 @@ static inline __u32
 jailhouse_system_config_size(struct jailhouse_system *system)
 {
 	return sizeof(*system) - sizeof(system->root_cell) +
-		   jailhouse_cell_config_size(&system->root_cell);
+		   jailhouse_cell_config_size(&system->root_cell) +
+		   system->num_numa_nodes * sizeof(struct jailhouse_numa_node) +
+		   system->num_cpus * sizeof(__u32);
 }
 
 static inline const struct jailhouse_memory *
@@ -86,4 +114,20 @@ jailhouse_cell_mem_regions(const struct jailhouse_cell_desc *cell)
 										 sizeof(struct jailhouse_cell_desc));
 }
 
+static inline const struct jailhouse_numa_node *
+jailhouse_system_numa_nodes(const struct jailhouse_system *system)
+{
+	return (const struct jailhouse_numa_node
+				*)(jailhouse_cell_mem_regions(&system->root_cell) +
+				   system->root_cell.num_memory_regions);
+}
+
+/* Node of each CPU, an index into jailhouse_system_numa_nodes() */
+static inline const __u32 *
+jailhouse_system_cpu_nodes(const struct jailhouse_system *system)
+{
+	return (const __u32 *)(jailhouse_system_numa_nodes(system) +
+						   system->num_numa_nodes);
+}
+
 #endif /* !_JAILHOUSE_CELL_CONFIG_H */
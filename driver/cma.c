@@ -0,0 +1,98 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * hv_region and rt_region allocated at enable time from a CMA area instead
+ * of being reserved at boot. While the hypervisor is disabled, Linux uses
+ * the area for movable pages such as the page cache. The area itself still
+ * has to be set aside at boot, e.g. with cma=SIZE, as modules cannot
+ * declare one.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#include <linux/cma.h>
+#include <linux/kernel.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+
+#include "cma.h"
+
+static char *cma_area = "reserved";
+module_param(cma_area, charp, S_IRUGO);
+MODULE_PARM_DESC(
+	cma_area,
+	"CMA area to allocate regions from that enable passes without address "
+	"(default: the cma= area)");
+
+typeof(cma_for_each_area) *cma_for_each_area_sym;
+
+static int cma_match(struct cma *cma, void *data)
+{
+	struct cma **found = data;
+
+	if (strcmp(cma_get_name(cma), cma_area) != 0)
+		return 0;
+	*found = cma;
+	return 1;
+}
+
+static struct cma *cma_find(void)
+{
+	struct cma *found = NULL;
+
+	if (!cma_for_each_area_sym)
+	{
+		pr_err("jailhouse: cannot look up the CMA areas\n");
+		return NULL;
+	}
+	cma_for_each_area_sym(cma_match, &found);
+	if (!found)
+		pr_err("jailhouse: no CMA area \"%s\"\n", cma_area);
+	return found;
+}
+
+/**
+ * Allocate a physically contiguous region.
+ * @param region	Output, start and size of the region.
+ * @param size		Size, rounded up to @c align.
+ * @param align		Alignment of start and size, a power of two of at least
+ *			PAGE_SIZE.
+ *
+ * @return 0 on success, -ENODEV without the CMA area, -ENOMEM if it has no
+ * room.
+ */
+int jailhouse_cma_alloc(
+	struct mem_region *region, unsigned long long size, unsigned long align)
+{
+	unsigned long count = ALIGN(size, align) >> PAGE_SHIFT;
+	struct cma *cma = cma_find();
+	struct page *pages;
+
+	if (!cma)
+		return -ENODEV;
+
+	pages = cma_alloc(cma, count, ilog2(align >> PAGE_SHIFT), false);
+	if (!pages)
+	{
+		pr_err(
+			"jailhouse: CMA area \"%s\" has no room for 0x%lx bytes\n",
+			cma_area, count << PAGE_SHIFT);
+		return -ENOMEM;
+	}
+	region->start = page_to_phys(pages);
+	region->size = (unsigned long long)count << PAGE_SHIFT;
+	return 0;
+}
+
+/* Give a region from jailhouse_cma_alloc() back to the CMA area. */
+void jailhouse_cma_free(struct mem_region *region)
+{
+	struct cma *cma = cma_find();
+
+	if (cma && region->size)
+		cma_release(
+			cma, phys_to_page(region->start), region->size >> PAGE_SHIFT);
+	region->start = region->size = 0;
+}
@@ -0,0 +1,29 @@
+#ifndef _JAILHOUSE_CMA_H
+#define _JAILHOUSE_CMA_H
+
+#include <linux/errno.h>
+
+#include "jailhouse.h"
+
+#ifdef CONFIG_CMA
+#include <linux/cma.h>
+
+/* Not exported, resolved by jailhouse_init() */
+extern typeof(cma_for_each_area) *cma_for_each_area_sym;
+
+int jailhouse_cma_alloc(
+	struct mem_region *region, unsigned long long size, unsigned long align);
+void jailhouse_cma_free(struct mem_region *region);
+#else /* !CONFIG_CMA */
+static inline int jailhouse_cma_alloc(
+	struct mem_region *region, unsigned long long size, unsigned long align)
+{
+	return -EOPNOTSUPP;
+}
+
+static inline void jailhouse_cma_free(struct mem_region *region)
+{
+}
+#endif /* !CONFIG_CMA */
+
+#endif /* !_JAILHOUSE_CMA_H */
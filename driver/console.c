@@ -0,0 +1,199 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Read-only mapping of the hypervisor console ring on
+ * /dev/jailhouse-console.
+ *
+ * The hypervisor cannot signal Linux, so new output is detected by polling
+ * the ring's tail. poll() on the device is edge-triggered: it reports
+ * EPOLLIN once per change of the tail, and EPOLLHUP once the hypervisor is
+ * gone. Readers consume the content straight from the mapping.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#include <linux/fs.h>
+#include <linux/jiffies.h>
+#include <linux/miscdevice.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/poll.h>
+#include <linux/string.h>
+#include <linux/version.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
+
+#include "console.h"
+#include "jailhouse.h"
+
+static unsigned int console_poll_ms = 20;
+module_param(console_poll_ms, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(
+	console_poll_ms, "Interval of checking the hypervisor console for output");
+
+/* Protects the console area against being started or stopped */
+static DEFINE_MUTEX(console_lock);
+static struct jailhouse_console *console_area;
+static phys_addr_t console_phys;
+static unsigned long console_area_size;
+/* Device inode of the mappings, to revoke them */
+static struct inode *console_inode;
+
+/* Tail as last seen by console_poll_fn() */
+static u64 console_tail;
+static DECLARE_WAIT_QUEUE_HEAD(console_wait);
+
+static void console_poll_fn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(console_poll_work, console_poll_fn);
+
+static void console_poll_fn(struct work_struct *work)
+{
+	u64 tail = READ_ONCE(console_area->tail);
+
+	if (tail != console_tail)
+	{
+		WRITE_ONCE(console_tail, tail);
+		wake_up_interruptible(&console_wait);
+	}
+	schedule_delayed_work(
+		&console_poll_work, msecs_to_jiffies(max(console_poll_ms, 1U)));
+}
+
+/* Prepare the control page before the hypervisor is entered. */
+void jailhouse_console_setup(void *area, unsigned long size)
+{
+	struct jailhouse_console *console = area;
+
+	memset(console, 0, sizeof(*console));
+	console->size = size - JAILHOUSE_CONSOLE_CONTENT;
+}
+
+/* Allow mapping the console of the hypervisor that was just entered. */
+void jailhouse_console_start(void *area, phys_addr_t phys, unsigned long size)
+{
+	mutex_lock(&console_lock);
+	console_area = area;
+	console_phys = phys;
+	console_area_size = size;
+	console_tail = 0;
+	mutex_unlock(&console_lock);
+
+	schedule_delayed_work(&console_poll_work, 0);
+}
+
+void jailhouse_console_stop(void)
+{
+	cancel_delayed_work_sync(&console_poll_work);
+
+	mutex_lock(&console_lock);
+	console_area = NULL;
+	mutex_unlock(&console_lock);
+
+	wake_up_interruptible(&console_wait);
+}
+
+static int console_open(struct inode *inode, struct file *file)
+{
+	if (file->f_mode & FMODE_WRITE)
+		return -EPERM;
+	/* f_pos holds the tail reported by the last EPOLLIN */
+	file->f_pos = 0;
+	return 0;
+}
+
+static __poll_t console_poll(struct file *file, poll_table *wait)
+{
+	__poll_t mask = 0;
+	u64 tail;
+
+	poll_wait(file, &console_wait, wait);
+
+	if (!READ_ONCE(console_area))
+		return EPOLLHUP;
+
+	tail = READ_ONCE(console_tail);
+	if (tail != file->f_pos)
+	{
+		file->f_pos = tail;
+		mask = EPOLLIN | EPOLLRDNORM;
+	}
+
+	return mask;
+}
+
+static int console_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	unsigned long size = vma->vm_end - vma->vm_start;
+	int err;
+
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+
+	mutex_lock(&console_lock);
+	err = -ENODEV;
+	if (!console_area)
+		goto out;
+	err = -EINVAL;
+	if (vma->vm_pgoff || size > console_area_size)
+		goto out;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+	vm_flags_clear(vma, VM_MAYWRITE);
+#else
+	vma->vm_flags &= ~VM_MAYWRITE;
+#endif
+	err = remap_pfn_range(
+		vma, vma->vm_start, PHYS_PFN(console_phys), size, vma->vm_page_prot);
+	if (!err && console_inode != file_inode(file))
+	{
+		iput(console_inode);
+		console_inode = file_inode(file);
+		ihold(console_inode);
+	}
+
+out:
+	mutex_unlock(&console_lock);
+	return err;
+}
+
+static const struct file_operations console_fops = {
+	.owner = THIS_MODULE,
+	.open = console_open,
+	.poll = console_poll,
+	.mmap = console_mmap,
+	.llseek = noop_llseek,
+};
+
+static struct miscdevice console_misc_dev = {
+	.minor = MISC_DYNAMIC_MINOR,
+	.name = "jailhouse-console",
+	.fops = &console_fops,
+};
+
+/*
+ * Zap all mappings of the console area before the hypervisor memory is
+ * freed. The console has to be stopped, so that it cannot be mapped again.
+ */
+void jailhouse_console_revoke(void)
+{
+	mutex_lock(&console_lock);
+	if (console_inode)
+	{
+		unmap_mapping_range(console_inode->i_mapping, 0, 0, 1);
+		iput(console_inode);
+		console_inode = NULL;
+	}
+	mutex_unlock(&console_lock);
+}
+
+int jailhouse_console_init(void)
+{
+	return misc_register(&console_misc_dev);
+}
+
+void jailhouse_console_exit(void)
+{
+	misc_deregister(&console_misc_dev);
+}
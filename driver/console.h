@@ -0,0 +1,14 @@
+#ifndef _JAILHOUSE_CONSOLE_H
+#define _JAILHOUSE_CONSOLE_H
+
+#include <linux/types.h>
+
+int jailhouse_console_init(void);
+void jailhouse_console_exit(void);
+
+void jailhouse_console_setup(void *area, unsigned long size);
+void jailhouse_console_start(void *area, phys_addr_t phys, unsigned long size);
+void jailhouse_console_stop(void);
+void jailhouse_console_revoke(void);
+
+#endif /* !_JAILHOUSE_CONSOLE_H */
@@ -0,0 +1,176 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Batched hypercalls through per-CPU rings in the hypervisor memory.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#include <linux/errno.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/rwsem.h>
+#include <linux/smp.h>
+#include <linux/string.h>
+
+#include "hc-ring.h"
+#include "hypercall.h"
+
+/* Held for reading while submitting, for writing while the hypervisor is
+ * entered or left. */
+static DECLARE_RWSEM(hc_ring_sem);
+static bool hc_ring_active;
+/* NULL if the hypervisor has no rings, calls are then issued one by one */
+static void *hc_rings;
+static unsigned int hc_ring_cpus;
+
+static struct jailhouse_hc_ring *hc_ring_of(unsigned int cpu)
+{
+	return hc_rings + cpu * PAGE_SIZE;
+}
+
+/*
+ * Clear the rings before entering the hypervisor, they are shared with it
+ * from then on.
+ */
+void jailhouse_hc_ring_init(void *rings, unsigned int num_cpus)
+{
+	BUILD_BUG_ON(sizeof(struct jailhouse_hc_ring) > PAGE_SIZE);
+
+	memset(rings, 0, num_cpus * PAGE_SIZE);
+}
+
+/* Accept submissions after the hypervisor was entered, rings may be NULL. */
+void jailhouse_hc_ring_start(void *rings, unsigned int num_cpus)
+{
+	down_write(&hc_ring_sem);
+	hc_rings = rings;
+	hc_ring_cpus = num_cpus;
+	hc_ring_active = true;
+	up_write(&hc_ring_sem);
+}
+
+/* Wait for running submissions and refuse new ones. */
+void jailhouse_hc_ring_stop(void)
+{
+	down_write(&hc_ring_sem);
+	hc_ring_active = false;
+	hc_rings = NULL;
+	up_write(&hc_ring_sem);
+}
+
+/*
+ * Drop the submissions the hypervisor did not take and the completions not
+ * collected, so that the next flush starts from indexes both sides agree
+ * on. The doorbell is synchronous, the hypervisor does not touch the ring
+ * meanwhile.
+ */
+static void hc_ring_resync(struct jailhouse_hc_ring *ring)
+{
+	WRITE_ONCE(ring->sq_tail, READ_ONCE(ring->sq_head));
+	WRITE_ONCE(ring->cq_head, READ_ONCE(ring->cq_tail));
+}
+
+/*
+ * Submit up to JAILHOUSE_HC_RING_ENTRIES calls on the ring of the current
+ * CPU and collect their results with a single hypercall.
+ */
+static int hc_ring_flush(
+	struct jailhouse_hc_ring *ring, struct jailhouse_hc_request *reqs,
+	unsigned int num)
+{
+	struct jailhouse_hc_sqe *sqe;
+	struct jailhouse_hc_cqe *cqe;
+	u32 head, tail;
+	unsigned int n;
+	int err;
+
+	tail = ring->sq_tail;
+	for (n = 0; n < num; n++)
+	{
+		sqe = &ring->sq[(tail + n) % JAILHOUSE_HC_RING_ENTRIES];
+		sqe->num = reqs[n].num;
+		sqe->arg1 = reqs[n].arg1;
+		sqe->arg2 = reqs[n].arg2;
+		sqe->cookie = n;
+	}
+	smp_wmb();
+	WRITE_ONCE(ring->sq_tail, tail + num);
+
+	err = (int)jailhouse_call(JAILHOUSE_HC_RING_DOORBELL);
+	if (err)
+	{
+		hc_ring_resync(ring);
+		return err;
+	}
+
+	head = ring->cq_head;
+	tail = READ_ONCE(ring->cq_tail);
+	smp_rmb();
+	if (tail - head != num)
+	{
+		pr_err(
+			"jailhouse: hypercall ring completed %u of %u calls\n",
+			tail - head, num);
+		err = -EIO;
+	}
+	for (; head != tail; head++)
+	{
+		cqe = &ring->cq[head % JAILHOUSE_HC_RING_ENTRIES];
+		if (cqe->cookie < num)
+			reqs[cqe->cookie].result = cqe->result;
+	}
+	WRITE_ONCE(ring->cq_head, head);
+	if (err)
+		hc_ring_resync(ring);
+
+	return err;
+}
+
+/**
+ * Issue a batch of hypercalls. With hypervisor support, they are queued on
+ * the ring of the current CPU and flushed with one doorbell hypercall per
+ * JAILHOUSE_HC_RING_ENTRIES calls, otherwise issued one by one.
+ * @param reqs		Calls to issue, their results are written back.
+ * @param num		Number of calls.
+ *
+ * Must be called from process context.
+ *
+ * @return 0 on success, -ENODEV if the hypervisor is not enabled, -EIO if
+ * it did not complete all calls.
+ */
+int jailhouse_hc_submit(struct jailhouse_hc_request *reqs, unsigned int num)
+{
+	unsigned int done, chunk, n, cpu;
+	int err = 0;
+
+	down_read(&hc_ring_sem);
+	if (!hc_ring_active)
+	{
+		err = -ENODEV;
+		goto out;
+	}
+
+	for (done = 0; done < num && !err; done += chunk)
+	{
+		chunk = min_t(unsigned int, num - done, JAILHOUSE_HC_RING_ENTRIES);
+
+		cpu = get_cpu();
+		if (hc_rings && cpu < hc_ring_cpus)
+			err = hc_ring_flush(hc_ring_of(cpu), reqs + done, chunk);
+		else
+			for (n = done; n < done + chunk; n++)
+				reqs[n].result = jailhouse_call_arg2(
+					reqs[n].num, reqs[n].arg1, reqs[n].arg2);
+		put_cpu();
+
+		cond_resched();
+	}
+
+out:
+	up_read(&hc_ring_sem);
+	return err;
+}
+EXPORT_SYMBOL(jailhouse_hc_submit);
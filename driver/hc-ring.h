@@ -0,0 +1,22 @@
+#ifndef _JAILHOUSE_HC_RING_H
+#define _JAILHOUSE_HC_RING_H
+
+#include "jailhouse.h"
+
+/* A hypercall issued through jailhouse_hc_submit() */
+struct jailhouse_hc_request
+{
+	__u32 num;
+	/* written back by jailhouse_hc_submit() */
+	__u32 result;
+	__u64 arg1;
+	__u64 arg2;
+};
+
+void jailhouse_hc_ring_init(void *rings, unsigned int num_cpus);
+void jailhouse_hc_ring_start(void *rings, unsigned int num_cpus);
+void jailhouse_hc_ring_stop(void);
+
+int jailhouse_hc_submit(struct jailhouse_hc_request *reqs, unsigned int num);
+
+#endif /* !_JAILHOUSE_HC_RING_H */
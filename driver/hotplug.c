@@ -0,0 +1,137 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Memory hotplug of the part of hv_region the hypervisor does not use, so
+ * that a generous reservation does not keep memory idle. The memory stays
+ * with Linux across disable and enable and is only removed on unload, or
+ * when hv_region moves. Memory that cannot be removed on unload is taken
+ * over again by the next load of the module.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#include <linux/ioport.h>
+#include <linux/kernel.h>
+#include <linux/memory.h>
+#include <linux/memory_hotplug.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/version.h>
+
+#include "hotplug.h"
+
+#define HOTPLUG_NAME "System RAM (jailhouse)"
+
+/* Memory added to Linux, size 0 if none */
+static struct mem_region plugged;
+static int plugged_nid;
+/* The resource of the added memory refers to its name until removal. */
+static const char *plugged_name;
+
+/* Granularity of memory hotplug */
+unsigned long jailhouse_hotplug_block_size(void)
+{
+	return memory_block_size_bytes();
+}
+
+/**
+ * Add @c region, aligned to jailhouse_hotplug_block_size(), to Linux as
+ * driver-managed "System RAM (jailhouse)". Whether it is onlined right away
+ * depends on the memory hotplug policy of the kernel.
+ *
+ * @return 0 on success, negative error code otherwise.
+ */
+int jailhouse_hotplug_add(const struct mem_region *region)
+{
+	int err;
+
+	if (plugged.size)
+		return -EBUSY;
+
+	plugged_name = kstrdup(HOTPLUG_NAME, GFP_KERNEL);
+	if (!plugged_name)
+		return -ENOMEM;
+
+	plugged_nid = memory_add_physaddr_to_nid(region->start);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0)
+	err = add_memory_driver_managed(
+		plugged_nid, region->start, region->size, plugged_name, MHP_NONE);
+#else
+	err = add_memory_driver_managed(
+		plugged_nid, region->start, region->size, plugged_name);
+#endif
+	if (err)
+	{
+		kfree(plugged_name);
+		plugged_name = NULL;
+		return err;
+	}
+	plugged = *region;
+	return 0;
+}
+
+/* The memory added by jailhouse_hotplug_add(), NULL if none. */
+const struct mem_region *jailhouse_hotplug_region(void)
+{
+	return plugged.size ? &plugged : NULL;
+}
+
+/*
+ * Take over the memory an earlier load of the module added but could not
+ * remove on unload. Its resource still carries the name that load
+ * allocated, which is freed once the memory is removed.
+ */
+void jailhouse_hotplug_init(void)
+{
+	struct resource *res;
+
+	for (res = iomem_resource.child; res; res = res->sibling)
+		if (res->name && strcmp(res->name, HOTPLUG_NAME) == 0)
+		{
+			plugged.start = res->start;
+			plugged.size = resource_size(res);
+			plugged_nid = memory_add_physaddr_to_nid(res->start);
+			plugged_name = res->name;
+			pr_info(
+				"jailhouse: [0x%llx-0x%llx] is still added to Linux\n",
+				plugged.start, plugged.start + plugged.size - 1);
+			return;
+		}
+}
+
+/**
+ * Take the added memory back from Linux. If it cannot be offlined, it stays
+ * with Linux and remains the added memory.
+ *
+ * @return 0 on success or without added memory, negative error code
+ * otherwise.
+ */
+int jailhouse_hotplug_remove(void)
+{
+	int err = -EOPNOTSUPP;
+
+	if (!plugged.size)
+		return 0;
+
+#ifdef CONFIG_MEMORY_HOTREMOVE
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 15, 0)
+	err = offline_and_remove_memory(plugged.start, plugged.size);
+#else
+	err = offline_and_remove_memory(
+		plugged_nid, plugged.start, plugged.size);
+#endif
+#endif
+	if (err)
+	{
+		pr_warn(
+			"jailhouse: leaving [0x%llx-0x%llx] to Linux, removal failed: "
+			"%d\n",
+			plugged.start, plugged.start + plugged.size - 1, err);
+		return err;
+	}
+	kfree(plugged_name);
+	plugged_name = NULL;
+	plugged.size = 0;
+	return 0;
+}
@@ -0,0 +1,40 @@
+#ifndef _JAILHOUSE_HOTPLUG_H
+#define _JAILHOUSE_HOTPLUG_H
+
+#include <linux/errno.h>
+
+#include "jailhouse.h"
+
+#ifdef CONFIG_MEMORY_HOTPLUG
+unsigned long jailhouse_hotplug_block_size(void);
+void jailhouse_hotplug_init(void);
+int jailhouse_hotplug_add(const struct mem_region *region);
+const struct mem_region *jailhouse_hotplug_region(void);
+int jailhouse_hotplug_remove(void);
+#else /* !CONFIG_MEMORY_HOTPLUG */
+static inline unsigned long jailhouse_hotplug_block_size(void)
+{
+	return 0;
+}
+
+static inline void jailhouse_hotplug_init(void)
+{
+}
+
+static inline int jailhouse_hotplug_add(const struct mem_region *region)
+{
+	return -EOPNOTSUPP;
+}
+
+static inline const struct mem_region *jailhouse_hotplug_region(void)
+{
+	return NULL;
+}
+
+static inline int jailhouse_hotplug_remove(void)
+{
+	return 0;
+}
+#endif /* !CONFIG_MEMORY_HOTPLUG */
+
+#endif /* !_JAILHOUSE_HOTPLUG_H */
@@ -0,0 +1,151 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Layout of the hypervisor memory as set up by the driver. Also used by
+ * the jailhouse tool to size the memory reservation, so that both agree.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#ifndef _JAILHOUSE_HV_LAYOUT_H
+#define _JAILHOUSE_HV_LAYOUT_H
+
+#if defined(__KERNEL__) && !defined(JAILHOUSE_USERSPACE)
+#include <linux/string.h>
+#else
+#include <string.h>
+#endif
+
+#include "jailhouse.h"
+#include "regions.h"
+
+/* Default of the console_size module parameter */
+#define JAILHOUSE_CONSOLE_DEFAULT_SIZE 0x100000
+
+struct jailhouse_hv_layout_params
+{
+	unsigned long page_size;
+	/** JAILHOUSE_HDR_* features, see jailhouse_header_features(). */
+	unsigned int features;
+	unsigned int max_cpus;
+	unsigned long core_size;
+	/** 0 if the per-CPU areas are not in the hypervisor memory. */
+	unsigned long percpu_size;
+	unsigned long config_size;
+	unsigned long console_size;
+};
+
+/**
+ * Offsets from the start of the hypervisor memory, 0 for areas the image
+ * does not use. The page pool of the hypervisor starts at @c end.
+ */
+struct jailhouse_hv_layout
+{
+	unsigned long config_offset;
+	unsigned long hc_ring_offset;
+	unsigned long stats_offset;
+	unsigned long console_offset;
+	unsigned long console_area_size;
+	unsigned long rt_cpu_set_offset;
+	unsigned long end;
+};
+
+/**
+ * The JAILHOUSE_HDR_* flags of an image that are valid for the revision of
+ * its extended header, 0 without one.
+ */
+static inline unsigned int jailhouse_header_features(
+	const struct jailhouse_header *header, unsigned long image_size)
+{
+	unsigned int features;
+
+	if (image_size < sizeof(*header) ||
+		memcmp(
+			header->ext_signature, JAILHOUSE_HEADER_EXT_SIGNATURE,
+			sizeof(header->ext_signature)) != 0)
+		return 0;
+
+	features = header->flags;
+	if (header->revision < 2)
+		features &= ~JAILHOUSE_HDR_HC_RING;
+	if (header->revision < 3)
+		features &= ~JAILHOUSE_HDR_STATS;
+	if (header->revision < 4)
+		features &= ~JAILHOUSE_HDR_CONSOLE;
+	if (header->revision < 5)
+		features &= ~(JAILHOUSE_HDR_RT_CPU_SET | JAILHOUSE_HDR_NUMA_PERCPU);
+	return features;
+}
+
+/**
+ * Upper bound of the root cell memory regions the driver generates from
+ * @c num_iomem top-level iomem entries, with node-local per-CPU memory
+ * carved out of them on up to @c num_nodes nodes. Each carve, one per node
+ * and one for the hypervisor memory, turns an entry into up to three, and
+ * the entry containing hv_region is split once more. Every region ends up
+ * in at most JAILHOUSE_MEM_REGION_MAX_SPLIT parts.
+ */
+static inline unsigned int
+jailhouse_max_mem_regions(unsigned int num_iomem, unsigned int num_nodes)
+{
+	return (num_iomem + 2 * (num_nodes + 1) + 1) *
+		   JAILHOUSE_MEM_REGION_MAX_SPLIT;
+}
+
+static inline unsigned long
+jailhouse_layout_align(unsigned long value, unsigned long align)
+{
+	return (value + align - 1) & ~(align - 1);
+}
+
+/**
+ * Place the system configuration behind the core and the per-CPU areas,
+ * followed by the areas shared with the hypervisor.
+ */
+static inline void jailhouse_hv_layout_init(
+	struct jailhouse_hv_layout *layout,
+	const struct jailhouse_hv_layout_params *params)
+{
+	unsigned long page = params->page_size, console;
+	unsigned long end;
+
+	memset(layout, 0, sizeof(*layout));
+	layout->config_offset =
+		params->core_size + params->max_cpus * params->percpu_size;
+	end = jailhouse_layout_align(
+		layout->config_offset + params->config_size, page);
+
+	if (params->features & JAILHOUSE_HDR_HC_RING)
+	{
+		layout->hc_ring_offset = end;
+		end += params->max_cpus * page;
+	}
+	if (params->features & JAILHOUSE_HDR_STATS)
+	{
+		layout->stats_offset = end;
+		end += jailhouse_layout_align(
+			params->max_cpus * sizeof(struct jailhouse_cpu_stats), page);
+	}
+	if (params->features & JAILHOUSE_HDR_CONSOLE)
+	{
+		/* a power of two of at least a page */
+		for (console = page; console < params->console_size; console <<= 1)
+			;
+		layout->console_offset = end;
+		layout->console_area_size = JAILHOUSE_CONSOLE_CONTENT + console;
+		end += layout->console_area_size;
+	}
+	if (params->features & JAILHOUSE_HDR_RT_CPU_SET)
+	{
+		layout->rt_cpu_set_offset = end;
+		/* a bitmap of unsigned long as written by the driver */
+		end += jailhouse_layout_align(
+			(params->max_cpus + 8 * sizeof(unsigned long) - 1) /
+				(8 * sizeof(unsigned long)) * sizeof(unsigned long),
+			page);
+	}
+	layout->end = end;
+}
+
+#endif /* !_JAILHOUSE_HV_LAYOUT_H */
@@ -2,6 +2,64 @@
 #define _JAILHOUSE_HYPERCALL_H
 
 #define JAILHOUSE_HC_DISABLE 0
+/* Process the hypercall ring of the calling CPU, see struct jailhouse_hc_ring.
+ * Returns 0 once all submitted calls are completed. */
+#define JAILHOUSE_HC_RING_DOORBELL 1
+/* Returns 0 without side effects, used to measure the hypercall latency. */
+#define JAILHOUSE_HC_NOP 2
+/* Leave the hypervisor on the calling CPU only, before Linux offlines it.
+ * Requires JAILHOUSE_HDR_CPU_HOTPLUG. */
+#define JAILHOUSE_HC_CPU_RELEASE 3
+/* Hand CPU arg1, offline in Linux, to arg2 (JAILHOUSE_CPU_*): start the RTOS
+ * on it, or stop the RTOS on it and park it for Linux to bring it online.
+ * Requires JAILHOUSE_HDR_CPU_HOTPLUG. */
+#define JAILHOUSE_HC_CPU_ASSIGN 4
+/* Move the Linux memory [arg1, arg1 + arg2) to the RT partition, or take it
+ * back, updating the root-cell and RT configuration to match. Reclaiming
+ * fails while the RTOS still uses the range. Requires
+ * JAILHOUSE_HDR_MEM_BALLOON. */
+#define JAILHOUSE_HC_MEM_DONATE 5
+#define JAILHOUSE_HC_MEM_RECLAIM 6
+
+#define JAILHOUSE_HC_RING_ENTRIES 64
+
+struct jailhouse_hc_sqe
+{
+	__u32 num;
+	__u32 padding;
+	__u64 arg1;
+	__u64 arg2;
+	/** Opaque, returned in the completion. */
+	__u64 cookie;
+};
+
+struct jailhouse_hc_cqe
+{
+	__u64 cookie;
+	__u32 result;
+	__u32 padding;
+};
+
+/**
+ * Hypercall submission and completion ring of one CPU, located in the
+ * hypervisor memory at jailhouse_header::hc_ring_offset + cpu * PAGE_SIZE.
+ *
+ * The driver produces submissions at sq_tail and consumes completions at
+ * cq_head, the hypervisor consumes submissions at sq_head and produces
+ * completions at cq_tail. The indexes run freely and are taken modulo
+ * JAILHOUSE_HC_RING_ENTRIES. A CPU only rings the doorbell for its own
+ * ring.
+ */
+struct jailhouse_hc_ring
+{
+	__u32 sq_head;
+	__u32 sq_tail;
+	__u32 cq_head;
+	__u32 cq_tail;
+	__u32 padding[12];
+	struct jailhouse_hc_sqe sq[JAILHOUSE_HC_RING_ENTRIES];
+	struct jailhouse_hc_cqe cq[JAILHOUSE_HC_RING_ENTRIES];
+};
 
 /*
  * As this is never called on a CPU without VM extensions,
@@ -32,6 +90,13 @@
  */
 extern bool jailhouse_use_vmcall;
 
+/**
+ * Set while a stand-in image (JAILHOUSE_HDR_STANDIN) is enabled. Calls are
+ * then passed to its stub instead of trapping into a hypervisor.
+ */
+extern __u32 (*jailhouse_standin_call)(
+	__u32 num, unsigned long arg1, unsigned long arg2);
+
 /**
  * Invoke a hypervisor without additional arguments.
  * @param num		Hypercall number.
@@ -42,6 +107,9 @@ static inline __u32 jailhouse_call(__u32 num)
 {
 	__u32 result;
 
+	if (unlikely(jailhouse_standin_call))
+		return jailhouse_standin_call(num, 0, 0);
+
 	asm volatile(JAILHOUSE_CALL_CODE
 				 : JAILHOUSE_CALL_RESULT
 				 : JAILHOUSE_USE_VMCALL, JAILHOUSE_CALL_NUM
@@ -60,6 +128,9 @@ static inline __u32 jailhouse_call_arg1(__u32 num, unsigned long arg1)
 {
 	__u32 result;
 
+	if (unlikely(jailhouse_standin_call))
+		return jailhouse_standin_call(num, arg1, 0);
+
 	asm volatile(JAILHOUSE_CALL_CODE
 				 : JAILHOUSE_CALL_RESULT
 				 : JAILHOUSE_USE_VMCALL, JAILHOUSE_CALL_NUM, JAILHOUSE_CALL_ARG1
@@ -80,6 +151,9 @@ jailhouse_call_arg2(__u32 num, unsigned long arg1, unsigned long arg2)
 {
 	__u32 result;
 
+	if (unlikely(jailhouse_standin_call))
+		return jailhouse_standin_call(num, arg1, arg2);
+
 	asm volatile(JAILHOUSE_CALL_CODE
 				 : JAILHOUSE_CALL_RESULT
 				 : JAILHOUSE_USE_VMCALL, JAILHOUSE_CALL_NUM,
@@ -0,0 +1,429 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Loading of the hypervisor image straight into the hypervisor memory.
+ * Enable only needs the header up front, so probing reads the first page
+ * of the image and identifies the file by its attributes. Loading reads a
+ * plain image into the destination or decompresses a zstd-compressed one
+ * (IMAGE.zst) into it, in one pass either way.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#include <linux/version.h>
+
+#include <generated/utsrelease.h>
+#include <linux/firmware.h>
+#include <linux/fs.h>
+#include <linux/kernel.h>
+#include <linux/math64.h>
+#include <linux/mm.h>
+#include <linux/namei.h>
+#include <linux/slab.h>
+#include <linux/stat.h>
+#include <linux/string.h>
+#include <linux/timekeeping.h>
+
+#if IS_ENABLED(CONFIG_ZSTD_DECOMPRESS) &&                                     \
+	LINUX_VERSION_CODE >= KERNEL_VERSION(5, 16, 0)
+#include <linux/zstd.h>
+#define IMAGE_ZSTD
+#endif
+
+#include "image.h"
+#include "jailhouse.h"
+
+char *fw_path_para_sym;
+
+/* Searched by the firmware loader after firmware_class.path, in order */
+static const char *const image_fw_dirs[] = {
+	"/lib/firmware/updates/" UTS_RELEASE,
+	"/lib/firmware/updates",
+	"/lib/firmware/" UTS_RELEASE,
+	"/lib/firmware",
+};
+
+static bool image_name_is_zstd(const char *name)
+{
+	size_t len = strlen(name);
+
+	return len > 4 && strcmp(name + len - 4, ".zst") == 0;
+}
+
+static int image_stat_path(
+	const char *dir, const char *name, struct jailhouse_image_file *file)
+{
+	struct kstat stat;
+	struct path path;
+	char *full;
+	int err;
+
+	full = kasprintf(GFP_KERNEL, "%s/%s", dir, name);
+	if (!full)
+		return -ENOMEM;
+	err = kern_path(full, LOOKUP_FOLLOW, &path);
+	kfree(full);
+	if (err)
+		return err;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 11, 0)
+	err = vfs_getattr(&path, &stat, STATX_BASIC_STATS, AT_STATX_SYNC_AS_STAT);
+#else
+	err = vfs_getattr(&path, &stat);
+#endif
+	path_put(&path);
+	if (err)
+		return err;
+	if (!S_ISREG(stat.mode))
+		return -ENOENT;
+
+	file->ino = stat.ino;
+	file->dev = stat.dev;
+	file->size = stat.size;
+	file->mtime_sec = stat.mtime.tv_sec;
+	file->mtime_nsec = stat.mtime.tv_nsec;
+	file->ctime_sec = stat.ctime.tv_sec;
+	file->ctime_nsec = stat.ctime.tv_nsec;
+	return 0;
+}
+
+/*
+ * Stat the file the firmware loader finds for a name, looking where it
+ * looks. firmware_class.path is only known if fw_path_para resolved.
+ * Returns -ENOENT if there is none, e.g. for built-in firmware.
+ */
+static int image_stat_name(const char *name, struct jailhouse_image_file *file)
+{
+	unsigned int n;
+
+	if (fw_path_para_sym && fw_path_para_sym[0] &&
+		image_stat_path(fw_path_para_sym, name, file) == 0)
+		return 0;
+	for (n = 0; n < ARRAY_SIZE(image_fw_dirs); n++)
+		if (image_stat_path(image_fw_dirs[n], name, file) == 0)
+			return 0;
+	return -ENOENT;
+}
+
+/*
+ * Stat the file jailhouse_image_probe() reads for @c fw_name, IMAGE.zst
+ * if there is one and zstd is supported, IMAGE otherwise.
+ */
+static int image_stat(const char *fw_name, struct jailhouse_image_file *file)
+{
+	char *name;
+	int err;
+
+#ifdef IMAGE_ZSTD
+	if (!image_name_is_zstd(fw_name))
+	{
+		name = kasprintf(GFP_KERNEL, "%s.zst", fw_name);
+		if (!name)
+			return -ENOMEM;
+		err = image_stat_name(name, file);
+		kfree(name);
+		if (err != -ENOENT)
+			return err;
+	}
+#endif
+	return image_stat_name(fw_name, file);
+}
+
+static bool image_file_equal(
+	const struct jailhouse_image_file *a,
+	const struct jailhouse_image_file *b)
+{
+	return a->ino == b->ino && a->dev == b->dev && a->size == b->size &&
+		   a->mtime_sec == b->mtime_sec && a->mtime_nsec == b->mtime_nsec &&
+		   a->ctime_sec == b->ctime_sec && a->ctime_nsec == b->ctime_nsec;
+}
+
+#ifdef IMAGE_ZSTD
+/*
+ * Request IMAGE.zst, or IMAGE itself if its name says it is compressed.
+ * Returns -ENOENT if there is no compressed image.
+ */
+static int image_zstd_request(struct jailhouse_image *image, struct device *dev)
+{
+	char *name;
+	int err;
+
+	if (image_name_is_zstd(image->name))
+	{
+		err = request_firmware(&image->zstd, image->name, dev);
+		if (err)
+			pr_err("jailhouse: Missing hypervisor image %s\n", image->name);
+		return err;
+	}
+
+	name = kasprintf(GFP_KERNEL, "%s.zst", image->name);
+	if (!name)
+		return -ENOMEM;
+	err = firmware_request_nowarn(&image->zstd, name, dev);
+	kfree(name);
+	return err ? -ENOENT : 0;
+}
+
+/* Decompress the first page of the image into image->head. */
+static int image_zstd_probe(struct jailhouse_image *image, struct device *dev)
+{
+	zstd_out_buffer out = {.dst = image->head, .size = PAGE_SIZE};
+	zstd_frame_header frame;
+	zstd_in_buffer in;
+	zstd_dstream *stream;
+	size_t wksp_size, ret, in_pos, out_pos;
+	void *wksp;
+	int err;
+
+	err = image_zstd_request(image, dev);
+	if (err)
+		return err;
+
+	in.src = image->zstd->data;
+	in.size = image->zstd->size;
+	in.pos = 0;
+	err = -EINVAL;
+	if (zstd_get_frame_header(&frame, in.src, in.size) != 0)
+		goto error_release;
+
+	err = -ENOMEM;
+	wksp_size = zstd_dstream_workspace_bound(frame.windowSize);
+	wksp = kvmalloc(wksp_size, GFP_KERNEL);
+	if (!wksp)
+		goto error_release;
+	stream = zstd_init_dstream(frame.windowSize, wksp, wksp_size);
+	if (!stream)
+	{
+		kvfree(wksp);
+		goto error_release;
+	}
+
+	/* until the page is full, the frame ends or no progress is made */
+	do
+	{
+		in_pos = in.pos;
+		out_pos = out.pos;
+		ret = zstd_decompress_stream(stream, &out, &in);
+	} while (!zstd_is_error(ret) && ret && out.pos < out.size &&
+			 (in.pos != in_pos || out.pos != out_pos));
+	kvfree(wksp);
+
+	err = -EINVAL;
+	if (zstd_is_error(ret))
+		goto error_release;
+	image->head_size = out.pos;
+	return 0;
+
+error_release:
+	if (err == -EINVAL)
+		pr_err("jailhouse: %s: corrupt zstd image\n", image->name);
+	release_firmware(image->zstd);
+	image->zstd = NULL;
+	return err;
+}
+
+/* Decompress in one pass, the destination serves as the window. */
+static ssize_t
+image_zstd_load(struct jailhouse_image *image, void *dst, size_t size)
+{
+	size_t wksp_size = zstd_dctx_workspace_bound();
+	zstd_dctx *dctx;
+	void *wksp;
+	size_t ret;
+
+	wksp = kvmalloc(wksp_size, GFP_KERNEL);
+	if (!wksp)
+		return -ENOMEM;
+	dctx = zstd_init_dctx(wksp, wksp_size);
+	if (!dctx)
+	{
+		kvfree(wksp);
+		return -ENOMEM;
+	}
+	ret = zstd_decompress_dctx(
+		dctx, dst, size, image->zstd->data, image->zstd->size);
+	kvfree(wksp);
+
+	if (!zstd_is_error(ret))
+		return ret;
+	if (zstd_get_error_code(ret) == ZSTD_error_dstSize_tooSmall)
+		return -EFBIG;
+	pr_err("jailhouse: %s: corrupt zstd image\n", image->name);
+	return -EINVAL;
+}
+#else /* !IMAGE_ZSTD */
+static int image_zstd_probe(struct jailhouse_image *image, struct device *dev)
+{
+	if (!image_name_is_zstd(image->name))
+		return -ENOENT;
+	pr_err("jailhouse: %s: kernel without zstd support\n", image->name);
+	return -EOPNOTSUPP;
+}
+
+static ssize_t
+image_zstd_load(struct jailhouse_image *image, void *dst, size_t size)
+{
+	return -EOPNOTSUPP;
+}
+#endif /* !IMAGE_ZSTD */
+
+/*
+ * Read the first page of the image into image->head. Kernels before 5.10
+ * cannot read part of a firmware file, the whole image is read there.
+ */
+static int image_plain_probe(struct jailhouse_image *image, struct device *dev)
+{
+	const struct firmware *fw;
+	int err;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0)
+	err = request_partial_firmware_into_buf(
+		&fw, image->name, dev, image->head, PAGE_SIZE, 0);
+#else
+	err = request_firmware(&fw, image->name, dev);
+#endif
+	if (err)
+	{
+		pr_err("jailhouse: Missing hypervisor image %s\n", image->name);
+		return err;
+	}
+	image->head_size = min_t(size_t, fw->size, PAGE_SIZE);
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 10, 0)
+	memcpy(image->head, fw->data, image->head_size);
+#endif
+	release_firmware(fw);
+	return 0;
+}
+
+static ssize_t image_plain_load(
+	struct jailhouse_image *image, void *dst, size_t size,
+	struct device *dev)
+{
+	const struct firmware *fw;
+	ssize_t len;
+	int err;
+
+	err = request_firmware_into_buf(&fw, image->name, dev, dst, size);
+	if (err)
+		return err;
+	len = fw->size;
+	release_firmware(fw);
+	return len;
+}
+
+/**
+ * Find the image and read its header. Keeps @c image if the image file is
+ * the same, otherwise replaces it on success only, with a new generation.
+ * Files the loader does not read from the usual directories always count
+ * as changed.
+ * @param image		Image to replace.
+ * @param fw_name	Firmware name of the image. IMAGE.zst is preferred
+ *			over IMAGE if it exists.
+ * @param dev		Device to request the firmware for.
+ *
+ * @return 0 on success, negative error code otherwise.
+ */
+int jailhouse_image_probe(
+	struct jailhouse_image *image, const char *fw_name, struct device *dev)
+{
+	struct jailhouse_image probed = {.generation = image->generation + 1};
+	const struct jailhouse_header *header;
+	int err;
+
+	/*
+	 * An unchanged file is not read at all. Taken before reading, a file
+	 * replaced meanwhile is probed again next time.
+	 */
+	probed.file_known = image_stat(fw_name, &probed.file) == 0;
+	if (probed.file_known && image->file_known &&
+		strcmp(image->name, fw_name) == 0 &&
+		image_file_equal(&image->file, &probed.file))
+		return 0;
+
+	probed.name = kstrdup(fw_name, GFP_KERNEL);
+	probed.head = kmalloc(PAGE_SIZE, GFP_KERNEL);
+	err = -ENOMEM;
+	if (!probed.name || !probed.head)
+		goto error;
+
+	err = image_zstd_probe(&probed, dev);
+	if (err == -ENOENT && !image_name_is_zstd(fw_name))
+		err = image_plain_probe(&probed, dev);
+	if (err)
+		goto error;
+
+	header = probed.head;
+	if (probed.head_size < sizeof(*header) ||
+		memcmp(
+			header->signature, JAILHOUSE_SIGNATURE,
+			sizeof(header->signature)) != 0)
+	{
+		pr_debug("jailhouse: %s: bad signature\n", probed.name);
+		err = -EINVAL;
+		goto error;
+	}
+
+	jailhouse_image_free(image);
+	*image = probed;
+	return 0;
+
+error:
+	jailhouse_image_free(&probed);
+	return err;
+}
+
+/**
+ * Load the probed image.
+ * @param image		Image from jailhouse_image_probe().
+ * @param dst		Destination, usually the start of the hypervisor
+ *			memory.
+ * @param size		Room at @c dst.
+ * @param dev		Device to request the firmware for.
+ *
+ * @return Size of the image on success, negative error code otherwise,
+ * -ESTALE if a plain image was replaced since it was probed, probing again
+ * picks up the new one.
+ */
+ssize_t jailhouse_image_load(
+	struct jailhouse_image *image, void *dst, size_t size,
+	struct device *dev)
+{
+	u64 start = ktime_get_ns(), nsec;
+	ssize_t len;
+
+	if (image->zstd)
+		len = image_zstd_load(image, dst, size);
+	else
+		len = image_plain_load(image, dst, size, dev);
+	if (len == -EFBIG)
+		pr_err(
+			"jailhouse: %s does not fit into the hypervisor memory\n",
+			image->name);
+	if (len < 0)
+		return len;
+
+	if ((size_t)len < image->head_size ||
+		memcmp(dst, image->head, image->head_size) != 0)
+	{
+		pr_warn("jailhouse: %s changed while being loaded\n", image->name);
+		return -ESTALE;
+	}
+
+	nsec = ktime_get_ns() - start;
+	pr_info(
+		"jailhouse: hypervisor image loaded%s, %zd bytes in %llu us\n",
+		image->zstd ? " from zstd" : "", len, div_u64(nsec, NSEC_PER_USEC));
+	return len;
+}
+
+void jailhouse_image_free(struct jailhouse_image *image)
+{
+	release_firmware(image->zstd);
+	kfree(image->head);
+	kfree(image->name);
+	image->zstd = NULL;
+	image->head = NULL;
+	image->name = NULL;
+	image->head_size = 0;
+	image->file_known = false;
+}
@@ -0,0 +1,50 @@
+#ifndef _JAILHOUSE_IMAGE_H
+#define _JAILHOUSE_IMAGE_H
+
+#include <linux/device.h>
+#include <linux/firmware.h>
+#include <linux/types.h>
+
+/* Not exported, resolved by jailhouse_init(), NULL if unknown */
+extern char *fw_path_para_sym;
+
+/** Identity of an image file, changes whenever the file is replaced. */
+struct jailhouse_image_file
+{
+	u64 ino;
+	dev_t dev;
+	loff_t size;
+	s64 mtime_sec, ctime_sec;
+	long mtime_nsec, ctime_nsec;
+};
+
+/**
+ * Hypervisor image found by jailhouse_image_probe(). Only its start is kept
+ * in memory, jailhouse_image_load() reads the rest straight into the
+ * hypervisor memory. A compressed image stays cached as such.
+ */
+struct jailhouse_image
+{
+	/** Firmware name of the image, NULL if none was probed. */
+	const char *name;
+	/** Start of the image, beginning with struct jailhouse_header. */
+	void *head;
+	/** Bytes at @c head, less than PAGE_SIZE only for shorter images. */
+	size_t head_size;
+	/** Changes when a probe finds a different image, 0 is never used. */
+	u64 generation;
+	/** File the image was read from, valid if @c file_known. */
+	struct jailhouse_image_file file;
+	bool file_known;
+	/** zstd-compressed image, NULL for a plain one. */
+	const struct firmware *zstd;
+};
+
+int jailhouse_image_probe(
+	struct jailhouse_image *image, const char *fw_name, struct device *dev);
+ssize_t jailhouse_image_load(
+	struct jailhouse_image *image, void *dst, size_t size,
+	struct device *dev);
+void jailhouse_image_free(struct jailhouse_image *image);
+
+#endif /* !_JAILHOUSE_IMAGE_H */
@@ -14,6 +14,7 @@ static const unsigned int ioremap_max_page_shift = PAGE_SHIFT;
 #endif /* CONFIG_HAVE_ARCH_HUGE_VMAP */
 
 struct mm_struct *init_mm_sym;
+struct jailhouse_map_stats jailhouse_map_stats;
 
 typeof(__pte_alloc_kernel) *__pte_alloc_kernel_sym;
 typeof(pud_free_pmd_page) *pud_free_pmd_page_sym;
@@ -23,6 +24,7 @@ typeof(pmd_free_pte_page) *pmd_free_pte_page_sym;
 typeof(__p4d_alloc) *__p4d_alloc_sym;
 typeof(__pud_alloc) *__pud_alloc_sym;
 typeof(__pmd_alloc) *__pmd_alloc_sym;
+typeof(arch_sync_kernel_mappings) *arch_sync_kernel_mappings_sym;
 
 /*** Page table manipulation functions ***/
 static int vmap_pte_range(
@@ -60,11 +62,13 @@ static int vmap_pte_range(
 			entry = arch_make_huge_pte(entry, ilog2(size), 0);
 			set_huge_pte_at(init_mm_sym, addr, pte, entry, size);
 			pfn += PFN_DOWN(size);
+			jailhouse_map_stats.pte++;
 			continue;
 		}
 #endif
 		set_pte_at(init_mm_sym, addr, pte, pfn_pte(pfn, prot));
 		pfn++;
+		jailhouse_map_stats.pte++;
 	} while (pte += PFN_DOWN(size), addr += size, addr != end);
 	*mask |= PGTBL_PTE_MODIFIED;
 	return 0;
@@ -113,6 +117,7 @@ static int vmap_pmd_range(
 		if (vmap_try_huge_pmd(pmd, addr, next, phys_addr, prot, max_page_shift))
 		{
 			*mask |= PGTBL_PMD_MODIFIED;
+			jailhouse_map_stats.pmd++;
 			continue;
 		}
 
@@ -165,6 +170,7 @@ static int vmap_pud_range(
 		if (vmap_try_huge_pud(pud, addr, next, phys_addr, prot, max_page_shift))
 		{
 			*mask |= PGTBL_PUD_MODIFIED;
+			jailhouse_map_stats.pud++;
 			continue;
 		}
 
@@ -254,8 +260,8 @@ static int vmap_range_noflush(
 			break;
 	} while (pgd++, phys_addr += (next - addr), addr = next, addr != end);
 
-	if (mask & ARCH_PAGE_TABLE_SYNC_MASK)
-		arch_sync_kernel_mappings(start, end);
+	if ((mask & ARCH_PAGE_TABLE_SYNC_MASK) && arch_sync_kernel_mappings_sym)
+		arch_sync_kernel_mappings_sym(start, end);
 
 	return err;
 }
@@ -265,6 +271,7 @@ int jailhouse_ioremap_page_range(
 {
 	int err;
 
+	memset(&jailhouse_map_stats, 0, sizeof(jailhouse_map_stats));
 	err =
 		vmap_range_noflush(addr, end, phys_addr, prot, ioremap_max_page_shift);
 	flush_cache_vmap(addr, end);
@@ -272,4 +279,17 @@ int jailhouse_ioremap_page_range(
 		err = kmsan_ioremap_page_range(
 			addr, end, phys_addr, prot, ioremap_max_page_shift);
 	return err;
-}
\ No newline at end of file
+}
+
+/*
+ * Propagate the top-level entries covering [addr, end) into the page tables
+ * of all mms, whether or not the last mapping allocated them. Returns false
+ * if the kernel offers no way to do so.
+ */
+bool jailhouse_sync_kernel_mappings(unsigned long addr, unsigned long end)
+{
+	if (!arch_sync_kernel_mappings_sym)
+		return false;
+	arch_sync_kernel_mappings_sym(addr, end);
+	return true;
+}
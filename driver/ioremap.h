@@ -1,3 +1,5 @@
+#include <linux/vmalloc.h>
+
 #include "pgalloc-track.h"
 
 extern struct mm_struct *init_mm_sym;
@@ -7,7 +9,19 @@ extern typeof(pud_free_pmd_page) *pud_free_pmd_page_sym;
 extern typeof(pmd_set_huge) *pmd_set_huge_sym;
 extern typeof(pud_set_huge) *pud_set_huge_sym;
 extern typeof(pmd_free_pte_page) *pmd_free_pte_page_sym;
+extern typeof(arch_sync_kernel_mappings) *arch_sync_kernel_mappings_sym;
+
+/* Page table entries used by the last jailhouse_ioremap_page_range() */
+struct jailhouse_map_stats
+{
+	unsigned long pud;
+	unsigned long pmd;
+	unsigned long pte;
+};
+
+extern struct jailhouse_map_stats jailhouse_map_stats;
 
 int jailhouse_ioremap_page_range(
 	unsigned long addr, unsigned long end, phys_addr_t phys_addr,
 	pgprot_t prot);
+bool jailhouse_sync_kernel_mappings(unsigned long addr, unsigned long end);
@@ -10,17 +10,270 @@ struct mem_region
 	unsigned long long size;
 };
 
+/* Load the hypervisor image again even if it did not change */
+#define JAILHOUSE_ENABLE_RELOAD 0x0001
+/* Require hv_region and rt_region to be aligned for, and the hypervisor
+ * memory to be mapped with, 2 MiB or 1 GiB pages */
+#define JAILHOUSE_ENABLE_ALIGN_2M 0x0002
+#define JAILHOUSE_ENABLE_ALIGN_1G 0x0004
+/* Take the SMT siblings of the RT CPUs away from Linux and pick at most
+ * one RT CPU per core */
+#define JAILHOUSE_ENABLE_RT_ISOLATE_SMT 0x0008
+/* Take the whole last-level cache domains of the RT CPUs away from Linux */
+#define JAILHOUSE_ENABLE_RT_ISOLATE_LLC 0x0010
+/* Return as soon as the enable is queued, its outcome is reported by
+ * JAILHOUSE_ENABLE_STATUS once poll() on the device signals completion */
+#define JAILHOUSE_ENABLE_ASYNC 0x0020
+/* Signal the eventfd in jailhouse_enable_args when the enable is done */
+#define JAILHOUSE_ENABLE_EVENTFD 0x0040
+
 struct jailhouse_enable_args
 {
 	struct mem_region hv_region;
 	struct mem_region rt_region;
+	__u32 flags;
+	/* number of RT CPUs the driver picks, 0 for 1; ignored with
+	 * rt_cpu_set */
+	__u32 rt_cpus;
+	/* pointer to a CPU bitmap of rt_cpu_set_size bytes selecting the RT
+	 * CPUs, 0 to let the driver pick them */
+	__u64 rt_cpu_set;
+	__u32 rt_cpu_set_size;
+	/* eventfd to signal on completion, with JAILHOUSE_ENABLE_EVENTFD */
+	__s32 eventfd;
+};
+
+/* Phases of JAILHOUSE_ENABLE/JAILHOUSE_DISABLE as reported by
+ * JAILHOUSE_ENABLE_STATUS and the jailhouse_phase_* and jailhouse_cpu_*
+ * trace events. */
+enum jailhouse_phase
+{
+	JAILHOUSE_PHASE_ENABLE,
+	JAILHOUSE_PHASE_FW_LOAD,
+	JAILHOUSE_PHASE_MEM_REGIONS,
+	JAILHOUSE_PHASE_IOREMAP,
+	JAILHOUSE_PHASE_COPY,
+	JAILHOUSE_PHASE_CONFIG,
+	JAILHOUSE_PHASE_FLUSH_ICACHE,
+	JAILHOUSE_PHASE_ENTER,
+	JAILHOUSE_PHASE_DISABLE,
+	JAILHOUSE_PHASE_LEAVE,
+	JAILHOUSE_NUM_PHASES,
+};
+
+/* Room for phases in struct jailhouse_enable_status */
+#define JAILHOUSE_STATUS_MAX_PHASES 16
+
+#define JAILHOUSE_ENABLE_IDLE 0
+#define JAILHOUSE_ENABLE_RUNNING 1
+#define JAILHOUSE_ENABLE_DONE 2
+
+/* Progress of the last enable */
+struct jailhouse_enable_status
+{
+	/* JAILHOUSE_ENABLE_IDLE before the first enable */
+	__u32 state;
+	/* 0 or negative error code once done */
+	__s32 result;
+	/* incremented by each enable */
+	__u32 seq;
+	/* phase begun last, enum jailhouse_phase */
+	__u32 phase;
+	/* result and duration of the last run of each phase, phase_nsec is 0
+	 * for phases that have not completed since the enable began */
+	__s32 phase_result[JAILHOUSE_STATUS_MAX_PHASES];
+	__u64 phase_nsec[JAILHOUSE_STATUS_MAX_PHASES];
+};
+
+#define JAILHOUSE_BENCH_BUCKETS 32
+#define JAILHOUSE_BENCH_MAX_ITERATIONS 1000000
+
+/* Hypercall latency of one CPU in TSC cycles */
+struct jailhouse_bench_cpu
+{
+	__u64 min;
+	__u64 avg;
+	__u64 p99;
+	__u64 max;
+	/* histogram[n] counts the calls that took [2^n, 2^(n+1)) cycles */
+	__u64 histogram[JAILHOUSE_BENCH_BUCKETS];
+	/* 0 if the CPU was not measured */
+	__u32 samples;
+	__u32 padding;
+};
+
+struct jailhouse_bench_hypercall
+{
+	/* null hypercalls per CPU */
+	__u32 iterations;
+	/* in: entries in cpus, out: entries written */
+	__u32 num_cpus;
+	/* pointer to struct jailhouse_bench_cpu, indexed by CPU number */
+	__u64 cpus;
+	/* out: TSC frequency */
+	__u64 tsc_khz;
+};
+
+/* Load an RTOS image from a file into rt_region */
+struct jailhouse_load_rt
+{
+	/* file descriptor open for reading */
+	__s32 fd;
+	__u32 padding;
+	/* where the image starts in the file */
+	__u64 file_offset;
+	/* bytes to read, 0 for up to the end of the file */
+	__u64 file_size;
+	/* destination offset in rt_region */
+	__u64 rt_offset;
+	/* bytes the image occupies in rt_region, the part after the file data
+	 * is cleared; 0 for just the file data */
+	__u64 mem_size;
+	/* entry point as offset in rt_region, must lie within the image */
+	__u64 entry;
+	/* out: physical address of the entry point */
+	__u64 entry_phys;
+	/* out: bytes read and time taken to read and clear them */
+	__u64 bytes;
+	__u64 nsec;
+};
+
+/* Where JAILHOUSE_CPU_ASSIGN moves a CPU */
+#define JAILHOUSE_CPU_LINUX 0
+#define JAILHOUSE_CPU_RT 1
+
+/* Move a CPU between Linux and the RT partition while enabled */
+struct jailhouse_cpu_assign
+{
+	__u32 cpu;
+	/* JAILHOUSE_CPU_LINUX or JAILHOUSE_CPU_RT */
+	__u32 target;
+};
+
+#define JAILHOUSE_BALLOON_INFLATE 0
+#define JAILHOUSE_BALLOON_DEFLATE 1
+/* Granularity of ballooned memory */
+#define JAILHOUSE_BALLOON_ALIGN 0x200000
+
+/* Move memory between Linux and the RT partition while enabled */
+struct jailhouse_balloon
+{
+	/* JAILHOUSE_BALLOON_INFLATE or JAILHOUSE_BALLOON_DEFLATE */
+	__u32 op;
+	__u32 padding;
+	/* inflate: bytes to give to the RT partition, a multiple of
+	 * JAILHOUSE_BALLOON_ALIGN; deflate, out: bytes taken back */
+	__u64 size;
+	/* inflate, out: physical start of the range given; deflate: start of
+	 * a range given before, taken back as a whole */
+	__u64 start;
+	/* out: bytes given to the RT partition in addition to rt_region */
+	__u64 total;
 };
 
 #define JAILHOUSE_ENABLE _IOW(0, 0, struct jailhouse_enable_args)
 #define JAILHOUSE_DISABLE _IO(0, 1)
+/* 2 is unused */
+#define JAILHOUSE_BENCH_HYPERCALL                                              \
+	_IOWR(0, 3, struct jailhouse_bench_hypercall)
+#define JAILHOUSE_LOAD_RT _IOWR(0, 4, struct jailhouse_load_rt)
+#define JAILHOUSE_ENABLE_STATUS _IOR(0, 5, struct jailhouse_enable_status)
+#define JAILHOUSE_CPU_ASSIGN _IOW(0, 6, struct jailhouse_cpu_assign)
+#define JAILHOUSE_BALLOON _IOWR(0, 7, struct jailhouse_balloon)
 
 #define JAILHOUSE_BASE 0xffffff0000000000UL
+#define JAILHOUSE_AMD_FW_NAME "evm-amd.bin"
+#define JAILHOUSE_INTEL_FW_NAME "evm-intel.bin"
 #define JAILHOUSE_SIGNATURE "EVMIMAGE"
+#define JAILHOUSE_HEADER_EXT_SIGNATURE "EVMHDREX"
+
+/*
+ * Incremented whenever fields are appended to the extended part of
+ * struct jailhouse_header.
+ */
+#define JAILHOUSE_HEADER_REVISION 7
+
+/* The hypervisor clears its page pool itself when allocating from it. */
+#define JAILHOUSE_HDR_LAZY_POOL 0x0001
+/* The hypervisor leaves its image intact when disabled and re-initializes
+ * its bss and per-CPU data on each entry, so it can be re-entered without
+ * being copied again. */
+#define JAILHOUSE_HDR_REENTRANT 0x0002
+/* The hypervisor serves JAILHOUSE_HC_RING_DOORBELL (revision 2). */
+#define JAILHOUSE_HDR_HC_RING 0x0004
+/* Not a hypervisor: entry() returns 0 without doing anything and is also
+ * called instead of issuing hypercalls. Allows testing the driver and
+ * tools on hosts without VMX or SVM. */
+#define JAILHOUSE_HDR_STANDIN 0x0008
+/* The hypervisor maintains struct jailhouse_cpu_stats (revision 3). */
+#define JAILHOUSE_HDR_STATS 0x0010
+/* The hypervisor logs into struct jailhouse_console (revision 4). */
+#define JAILHOUSE_HDR_CONSOLE 0x0020
+/* The hypervisor takes the RT CPUs from the bitmap at rt_cpu_set_offset
+ * instead of using the last rt_cpus CPUs (revision 5). */
+#define JAILHOUSE_HDR_RT_CPU_SET 0x0040
+/* The hypervisor takes its per-CPU areas from the NUMA node table of the
+ * system configuration where the driver placed them there (revision 5). */
+#define JAILHOUSE_HDR_NUMA_PERCPU 0x0080
+/* The hypervisor lets CPUs that come online later enter, serves
+ * JAILHOUSE_HC_CPU_RELEASE and JAILHOUSE_HC_CPU_ASSIGN (revision 6). */
+#define JAILHOUSE_HDR_CPU_HOTPLUG 0x0100
+/* The hypervisor serves JAILHOUSE_HC_MEM_DONATE and JAILHOUSE_HC_MEM_RECLAIM
+ * (revision 7). */
+#define JAILHOUSE_HDR_MEM_BALLOON 0x0200
+
+/* VM exit reasons counted in jailhouse_cpu_stats::exits */
+#define JAILHOUSE_EXIT_HYPERCALL 0
+#define JAILHOUSE_EXIT_MMIO 1
+#define JAILHOUSE_EXIT_PIO 2
+#define JAILHOUSE_EXIT_MSR 3
+#define JAILHOUSE_EXIT_CPUID 4
+#define JAILHOUSE_EXIT_XSETBV 5
+#define JAILHOUSE_EXIT_CR 6
+#define JAILHOUSE_EXIT_EXCEPTION 7
+#define JAILHOUSE_EXIT_INTERRUPT 8
+#define JAILHOUSE_EXIT_MANAGEMENT 9
+#define JAILHOUSE_EXIT_OTHER 10
+#define JAILHOUSE_NUM_EXIT_REASONS 16
+
+/**
+ * Statistics of one CPU, written by the hypervisor only. Each CPU's entry
+ * fills whole cache lines so that updates do not bounce between CPUs.
+ */
+struct jailhouse_cpu_stats
+{
+	/** Incremented before and after each update, odd while one is in
+	 * progress. Readers retry until they see the same even value before
+	 * and after reading. */
+	__u64 seq;
+	/** VM exits by reason, see JAILHOUSE_EXIT_*. */
+	__u64 exits[JAILHOUSE_NUM_EXIT_REASONS];
+	/** TSC cycles spent in the hypervisor. */
+	__u64 hv_cycles;
+	/** Interrupts injected into the root cell. */
+	__u64 irqs_injected;
+} __attribute__((aligned(64)));
+
+#define JAILHOUSE_CONSOLE_DEVICE "/dev/jailhouse-console"
+/* Offset of the content from the start of the console area */
+#define JAILHOUSE_CONSOLE_CONTENT 0x1000
+
+/**
+ * Control page of the hypervisor console ring, followed by its content at
+ * JAILHOUSE_CONSOLE_CONTENT. The driver maps both read-only to userspace
+ * through JAILHOUSE_CONSOLE_DEVICE.
+ */
+struct jailhouse_console
+{
+	/** Bytes written since the hypervisor was entered. Byte n is stored at
+	 * content offset n % size, tail is advanced after storing the bytes.
+	 * Readers that fall more than size bytes behind lost the oldest
+	 * ones. */
+	__u64 tail;
+	/** Size of the content, a power of two. */
+	__u32 size;
+	__u32 padding;
+};
 
 /**
  * Hypervisor description.
@@ -49,9 +302,60 @@ struct jailhouse_header
 	unsigned int max_cpus;
 	/** Number of real-time CPUs paritioned, which will be shutdown before
 	 * entry and restarted in hypervisor. The others are VM CPUs, which will
-	 * call the entry function and run the guest.
+	 * call the entry function and run the guest. Unless the hypervisor
+	 * supports rt_cpu_set_offset, these are the last rt_cpus CPUs.
 	 * @note Filled by Linux loader driver before entry. */
 	unsigned int rt_cpus;
+
+	/* The following fields are only valid if ext_signature matches. */
+
+	/** Signature "EVMHDREX" marking the presence of the extended header.
+	 * Without it, the driver clears the complete hypervisor memory.
+	 * @note Filled at build time. */
+	char ext_signature[8];
+	/** Revision of the extended header, see JAILHOUSE_HEADER_REVISION.
+	 * @note Filled at build time. */
+	unsigned int revision;
+	/** Zeroing contract, see JAILHOUSE_HDR_*.
+	 * With JAILHOUSE_HDR_LAZY_POOL, only the part of the core behind the
+	 * image (bss), percpu_clear_size bytes of each per-CPU area and the
+	 * page holding the end of the system configuration are cleared before
+	 * entry.
+	 * @note Filled at build time. */
+	unsigned int flags;
+	/** Bytes at the start of each per-CPU area that must be zero on entry.
+	 * 0 stands for the whole percpu_size.
+	 * @note Filled at build time. */
+	unsigned long percpu_clear_size;
+
+	/* Revision 2 */
+
+	/** Offset of the per-CPU hypercall rings from the start of the
+	 * hypervisor memory, one page per CPU. 0 if there are none.
+	 * @note Filled by Linux loader driver before entry. */
+	unsigned long hc_ring_offset;
+
+	/* Revision 3 */
+
+	/** Offset of the statistics, struct jailhouse_cpu_stats[max_cpus],
+	 * from the start of the hypervisor memory. 0 if there are none.
+	 * @note Filled by Linux loader driver before entry. */
+	unsigned long stats_offset;
+
+	/* Revision 4 */
+
+	/** Offset and size of the console area, see struct jailhouse_console.
+	 * 0 if there is none.
+	 * @note Filled by Linux loader driver before entry. */
+	unsigned long console_offset;
+	unsigned long console_size;
+
+	/* Revision 5 */
+
+	/** Offset of the bitmap of RT CPUs, max_cpus bits in unsigned longs,
+	 * from the start of the hypervisor memory. 0 if there is none.
+	 * @note Filled by Linux loader driver before entry. */
+	unsigned long rt_cpu_set_offset;
 };
 
 #endif /* !_JAILHOUSE_DRIVER_H */
@@ -19,24 +19,53 @@
 #include <asm/cacheflush.h>
 #include <asm/smp.h>
 #include <asm/tlbflush.h>
+#ifdef CONFIG_X86
+#include <asm/tsc.h>
+#endif
 #include <linux/cpu.h>
-#include <linux/firmware.h>
+#include <linux/cpuhotplug.h>
+#include <linux/eventfd.h>
 #include <linux/io.h>
 #include <linux/kallsyms.h>
 #include <linux/kernel.h>
 #include <linux/miscdevice.h>
 #include <linux/mm_types.h>
 #include <linux/module.h>
+#include <linux/nodemask.h>
+#include <linux/poll.h>
 #include <linux/reboot.h>
+#include <linux/rwsem.h>
+#include <linux/sizes.h>
 #include <linux/smp.h>
 #include <linux/uaccess.h>
 #include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+#include <linux/xxhash.h>
 
+#include "balloon.h"
+#include "bench.h"
 #include "cell-config.h"
+#include "cma.h"
 #include "compat.h"
+#include "console.h"
+#include "hc-ring.h"
+#include "hotplug.h"
+#include "hv-layout.h"
 #include "hypercall.h"
+#include "image.h"
 #include "ioremap.h"
 #include "jailhouse.h"
+#include "numa.h"
+#include "populate.h"
+#include "regions.h"
+#include "rendezvous.h"
+#include "rt-cpus.h"
+#include "rt-load.h"
+#include "rt-mmap.h"
+#include "sysfs.h"
+
+#define CREATE_TRACE_POINTS
+#include "trace.h"
 
 #ifdef CONFIG_X86_32
 #error 64-bit kernel required!
@@ -50,11 +79,6 @@
 	FEATURE_CONTROL_VMXON_ENABLED_OUTSIDE_SMX
 #endif
 
-#ifdef CONFIG_X86
-#define JAILHOUSE_AMD_FW_NAME "evm-amd.bin"
-#define JAILHOUSE_INTEL_FW_NAME "evm-intel.bin"
-#endif
-
 MODULE_DESCRIPTION("Management driver for Jailhouse partitioning hypervisor");
 MODULE_LICENSE("GPL");
 #ifdef CONFIG_X86
@@ -70,19 +94,120 @@ static void *hypervisor_mem;
 
 static struct device *jailhouse_dev;
 static unsigned long hv_core_and_percpu_size;
-static unsigned int max_cpus, rt_cpus, enter_hv_cpus;
+/* Offsets of the hypercall rings, the statistics, the console and the RT
+ * CPU bitmap in the hypervisor memory, 0 if there are none */
+static unsigned long hc_ring_offset, stats_offset, console_offset;
+static unsigned long rt_cpu_set_offset;
+static unsigned long console_area_size;
+static unsigned int max_cpus, rt_cpus;
+/* CPUs running under the hypervisor for Linux */
 static cpumask_t vm_cpus_mask;
-static atomic_t call_done;
-static int error_code;
+/* Held for reading by hypercall benchmarks, which run without
+ * jailhouse_lock, for writing while the hypervisor is left. */
+static DECLARE_RWSEM(bench_sem);
+/* CPUs coming and going enter and leave the hypervisor. Changed under
+ * cpus_read_lock(), read by the hotplug callbacks. */
+static bool cpuhp_follow;
+static enum cpuhp_state jailhouse_cpuhp_state;
+/* CPUs offlined for the RT partition: the RT CPUs and those parked next to
+ * them by the isolation policy */
+static cpumask_t rt_cpus_mask, parked_cpus_mask;
+/* From offline_rt_cpus() to online_rt_cpus(), the hotplug callbacks keep
+ * Linux off these CPUs meanwhile */
+static bool rt_cpus_taken;
+/* Per-CPU areas are in node-local memory instead of behind the core */
+static bool percpu_node_local;
 static struct resource *hypervisor_mem_res;
 static struct mem_region hv_region, rt_region;
+/* End of the reservation behind hv_region, returned to Linux */
+static struct mem_region hv_tail;
+/* Regions allocated by jailhouse_cma_alloc_regions() */
+static bool hv_region_cma, rt_region_cma;
+
+/* Hypervisor image probed by a previous enable */
+static struct jailhouse_image hv_image;
+/* Region currently mapped at hypervisor_mem, generation of the image
+ * loaded into it and hash of the configuration copied there, 0 if
+ * unknown */
+static struct mem_region mapped_region;
+static u64 loaded_image_gen, loaded_config_hash;
+/* Hypervisor mapping is present in the page tables of every mm */
+static bool hv_mappings_synced;
+
+/* Enable arguments with everything taken from the caller */
+struct jailhouse_enable_request
+{
+	struct jailhouse_enable_args args;
+	const char *fw_name;
+	unsigned long page_size;
+	/* RT CPUs requested with args.rt_cpu_set */
+	cpumask_var_t rt_cpu_set;
+	/* signalled once done, NULL without JAILHOUSE_ENABLE_EVENTFD */
+	struct eventfd_ctx *eventfd;
+};
+
+/* Progress of the last enable and start times of the running phases */
+static DEFINE_SPINLOCK(enable_status_lock);
+static struct jailhouse_enable_status enable_status;
+static u64 phase_start_ns[JAILHOUSE_NUM_PHASES];
+/* Woken when an enable is done */
+static DECLARE_WAIT_QUEUE_HEAD(enable_wait);
+
+/* Enable run by enable_work, see JAILHOUSE_ENABLE_ASYNC */
+static struct jailhouse_enable_request *enable_queued;
+static void jailhouse_enable_work_fn(struct work_struct *work);
+static DECLARE_WORK(enable_work, jailhouse_enable_work_fn);
 
 static typeof(ioremap_page_range) *ioremap_page_range_sym;
 static typeof(__get_vm_area_caller) *__get_vm_area_caller_sym;
 
+static char *fw_name_override = "";
+module_param_named(fw_name, fw_name_override, charp, S_IRUGO);
+MODULE_PARM_DESC(
+	fw_name,
+	"Hypervisor image to load instead of the one matching the CPU, e.g. a "
+	"stand-in image");
+
+static unsigned long console_size = JAILHOUSE_CONSOLE_DEFAULT_SIZE;
+module_param(console_size, ulong, S_IRUGO);
+MODULE_PARM_DESC(
+	console_size, "Size of the hypervisor console ring, a power of two");
+
 static char *hv_size = "";
 module_param(hv_size, charp, S_IRUGO);
-MODULE_PARM_DESC(hv_size, "The hypervisor size in string");
+MODULE_PARM_DESC(
+	hv_size,
+	"Memory of the hypervisor, e.g. 64M (default: what it needs plus "
+	"pool_size)");
+
+static unsigned long pool_size = SZ_32M;
+module_param(pool_size, ulong, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(
+	pool_size, "Page pool of the hypervisor if hv_size is not set");
+
+static bool return_unused = true;
+module_param(return_unused, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(
+	return_unused,
+	"Hot-add the memory blocks of the reservation the hypervisor does not "
+	"use to Linux");
+
+static bool numa_percpu = true;
+module_param(numa_percpu, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(
+	numa_percpu,
+	"Place the per-CPU data of the hypervisor in memory of the CPU's node, "
+	"if supported");
+
+static bool optimize_layout = true;
+module_param(optimize_layout, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(
+	optimize_layout,
+	"Coalesce root cell memory regions and split them at huge page "
+	"boundaries");
+
+__u32 (*jailhouse_standin_call)(
+	__u32 num, unsigned long arg1, unsigned long arg2);
 
 #ifdef CONFIG_X86
 bool jailhouse_use_vmcall;
@@ -148,18 +273,41 @@ int get_rt_memory_region(struct mem_region *region)
 
 EXPORT_SYMBOL(get_rt_memory_region);
 
+/* Trace the beginning of a phase and record it in the enable status. */
+static void jailhouse_phase_begin(unsigned int phase)
+{
+	trace_jailhouse_phase_begin(phase);
+
+	spin_lock(&enable_status_lock);
+	enable_status.phase = phase;
+	phase_start_ns[phase] = ktime_get_ns();
+	spin_unlock(&enable_status_lock);
+}
+
+static void jailhouse_phase_end(unsigned int phase, int err)
+{
+	trace_jailhouse_phase_end(phase, err);
+
+	spin_lock(&enable_status_lock);
+	enable_status.phase_result[phase] = err;
+	enable_status.phase_nsec[phase] = ktime_get_ns() - phase_start_ns[phase];
+	spin_unlock(&enable_status_lock);
+}
+
 /*
- * Called for each cpu by the JAILHOUSE_ENABLE ioctl.
- * It jumps to the entry point set in the header, reports the result and
- * signals completion to the main thread that invoked it.
+ * Called for each cpu by the JAILHOUSE_ENABLE ioctl through
+ * jailhouse_rendezvous(). It jumps to the entry point set in the header
+ * and returns the result.
  */
-static void enter_hypervisor(void *info)
+static int enter_hypervisor(void *info)
 {
 	struct jailhouse_header *header = info;
 	unsigned int cpu = smp_processor_id();
 	int (*entry)(unsigned int);
 	int err;
 
+	trace_jailhouse_cpu_begin(cpu, JAILHOUSE_PHASE_ENTER);
+
 	entry = header->entry + (unsigned long)hypervisor_mem;
 
 	if (cpu < header->max_cpus)
@@ -168,12 +316,9 @@ static void enter_hypervisor(void *info)
 	else
 		err = -EINVAL;
 
-	if (err)
-		error_code = err;
-
 #if defined(CONFIG_X86) && LINUX_VERSION_CODE >= KERNEL_VERSION(4, 0, 0)
 	/* on Intel, VMXE is now on - update the shadow */
-	if (boot_cpu_has(X86_FEATURE_VMX) && !err)
+	if (boot_cpu_has(X86_FEATURE_VMX) && !err && !jailhouse_standin_call)
 	{
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 5, 0)
 		cr4_set_bits_irqsoff(X86_CR4_VMXE);
@@ -183,11 +328,15 @@ static void enter_hypervisor(void *info)
 	}
 #endif
 
-	atomic_inc(&call_done);
+	trace_jailhouse_cpu_end(cpu, JAILHOUSE_PHASE_ENTER, err);
+
+	return err;
 }
 
 static inline const char *jailhouse_get_fw_name(void)
 {
+	if (fw_name_override[0])
+		return fw_name_override;
 #ifdef CONFIG_X86
 	if (boot_cpu_has(X86_FEATURE_SVM))
 		return JAILHOUSE_AMD_FW_NAME;
@@ -197,6 +346,83 @@ static inline const char *jailhouse_get_fw_name(void)
 	return NULL;
 }
 
+/*
+ * Returns true if the image carries the extended header in at least the
+ * given revision.
+ */
+static bool jailhouse_header_ext(
+	const struct jailhouse_header *header, size_t image_size,
+	unsigned int revision)
+{
+	return image_size >= sizeof(*header) &&
+		   memcmp(
+			   header->ext_signature, JAILHOUSE_HEADER_EXT_SIGNATURE,
+			   sizeof(header->ext_signature)) == 0 &&
+		   header->revision >= revision;
+}
+
+/*
+ * Collect the clear operations that prepare the hypervisor memory for
+ * entry once the image of image_size bytes is loaded at its start. Legacy
+ * images get everything behind the image cleared, images with
+ * JAILHOUSE_HDR_LAZY_POOL only what they declare as required.
+ *
+ * @ranges must have room for max_cpus + 1 entries.
+ */
+static unsigned int get_populate_ranges(
+	const struct jailhouse_header *header, size_t image_size,
+	struct jailhouse_populate_range *ranges)
+{
+	unsigned long percpu_clear;
+	unsigned int num = 0, cpu;
+
+	if (!jailhouse_header_ext(header, image_size, 1) ||
+		!(header->flags & JAILHOUSE_HDR_LAZY_POOL))
+	{
+		ranges[num].dst = hypervisor_mem + image_size;
+		ranges[num].src = NULL;
+		ranges[num].size = hv_region.size - image_size;
+		return num + 1;
+	}
+
+	/* bss and alignment padding of the core */
+	if (image_size < header->core_size)
+	{
+		ranges[num].dst = hypervisor_mem + image_size;
+		ranges[num].src = NULL;
+		ranges[num].size = header->core_size - image_size;
+		num++;
+	}
+
+	/* node-local per-CPU memory is allocated zeroed */
+	if (percpu_node_local)
+		return num;
+
+	percpu_clear = header->percpu_clear_size;
+	if (!percpu_clear || percpu_clear >= header->percpu_size)
+	{
+		ranges[num].dst = hypervisor_mem + header->core_size;
+		ranges[num].src = NULL;
+		ranges[num].size = max_cpus * header->percpu_size;
+		num++;
+	}
+	else
+	{
+		for (cpu = 0; cpu < max_cpus; cpu++)
+		{
+			ranges[num].dst = hypervisor_mem + header->core_size +
+							  cpu * header->percpu_size;
+			ranges[num].src = NULL;
+			ranges[num].size = percpu_clear;
+			num++;
+		}
+	}
+
+	/* The system configuration is copied, and the rest of its last page
+	 * cleared, by jailhouse_enable(). */
+	return num;
+}
+
 static void jailhouse_firmware_free(void)
 {
 	if (hypervisor_mem_res)
@@ -207,234 +433,503 @@ static void jailhouse_firmware_free(void)
 	}
 	vunmap(hypervisor_mem);
 	hypervisor_mem = NULL;
+	hv_mappings_synced = false;
+	mapped_region.start = mapped_region.size = 0;
+	loaded_image_gen = loaded_config_hash = 0;
+}
+
+/*
+ * Give regions allocated from CMA back, after revoking all mappings of
+ * them.
+ */
+static void jailhouse_cma_free_regions(void)
+{
+	struct mem_region region;
+
+	if (rt_region_cma)
+	{
+		/* faults on remaining mappings find rt_region gone */
+		region = rt_region;
+		if (jailhouse_rt_mmap_revoke(&rt_region) == 0)
+		{
+			jailhouse_cma_free(&region);
+			rt_region_cma = false;
+		}
+		else
+			pr_warn(
+				"jailhouse: rt_region is still mapped by the kernel, keeping "
+				"it allocated\n");
+	}
+	if (hv_region_cma)
+	{
+		jailhouse_console_revoke();
+		jailhouse_firmware_free();
+		jailhouse_cma_free(&hv_region);
+		hv_region_cma = false;
+	}
 }
 
-static int get_iomem_num(void)
+/*
+ * Snapshot the top-level entries of the iomem resource tree, with room for
+ * jailhouse_iomem_carve(). Returns the number of entries, or -ENOMEM. The
+ * caller kvfree()s @iomem.
+ */
+static int get_iomem_entries(struct jailhouse_iomem_entry **iomem)
 {
-	int num;
 	struct resource *child;
+	int n, num = 0;
+
+	for (child = iomem_resource.child; child; child = child->sibling)
+		num++;
+
+	/* two more entries per carve, see jailhouse_numa_percpu_carve() */
+	*iomem = kvmalloc_array(
+		num + 2 * (1 + nr_node_ids), sizeof(**iomem), GFP_KERNEL);
+	if (!*iomem)
+		return -ENOMEM;
 
-	num = 0;
 	child = iomem_resource.child;
-	while (child)
+	for (n = 0; n < num && child; n++, child = child->sibling)
 	{
-		num++;
-		child = child->sibling;
+		(*iomem)[n].start = child->start;
+		(*iomem)[n].end = child->end;
+		(*iomem)[n].name = child->name;
 	}
+	return n;
+}
 
-	return num;
+/*
+ * Dump hypervisor memory region and all memory regions reported to hypervisor.
+ */
+static void dump_mem_regions(struct jailhouse_memory *regions, int n)
+{
+	int i;
+	for (i = 0; i < n; i++)
+	{
+		pr_info(
+			"region[%d]: [0x%llx - 0x%llx], size=0x%llx, flag=0x%llx\n", i,
+			regions[i].phys_start, regions[i].phys_start + regions[i].size - 1,
+			regions[i].size, regions[i].flags);
+	}
 }
 
-static inline unsigned long long mem_region_flag(const char *name)
+/*
+ * Probe the hypervisor image on each enable, so that an updated image is
+ * noticed. Only its header is kept in memory, the image is loaded straight
+ * into the hypervisor memory whenever the copy there cannot be reused.
+ */
+static int jailhouse_get_firmware(const char *fw_name, bool reload)
 {
-	if (!strcmp(name, "System RAM") || !strcmp(name, "RAM buffer"))
-		return JAILHOUSE_MEM_READ | JAILHOUSE_MEM_WRITE |
-			   JAILHOUSE_MEM_EXECUTE | JAILHOUSE_MEM_DMA;
-	else if (!strcmp(name, "Reserved"))
-		return JAILHOUSE_MEM_READ | JAILHOUSE_MEM_WRITE | JAILHOUSE_MEM_EXECUTE;
-	else
-		return JAILHOUSE_MEM_READ | JAILHOUSE_MEM_WRITE;
+	int err;
+
+	err = jailhouse_image_probe(&hv_image, fw_name, jailhouse_dev);
+	/* reload copies the image even if it did not change */
+	if (!err && reload)
+		loaded_image_gen = 0;
+	return err;
+}
+
+/*
+ * Returns true if the image in hypervisor memory can be entered again
+ * without loading it anew.
+ */
+static bool jailhouse_image_reusable(void)
+{
+	const struct jailhouse_header *header = hv_image.head;
+
+	return loaded_image_gen == hv_image.generation &&
+		   jailhouse_header_ext(header, hv_image.head_size, 1) &&
+		   (header->flags & JAILHOUSE_HDR_REENTRANT);
+}
+
+/* Returns true if the image is a stand-in, see JAILHOUSE_HDR_STANDIN. */
+static bool jailhouse_image_is_standin(void)
+{
+	const struct jailhouse_header *header = hv_image.head;
+
+	return jailhouse_header_ext(header, hv_image.head_size, 1) &&
+		   (header->flags & JAILHOUSE_HDR_STANDIN);
+}
+
+/* Returns true if the image takes the RT CPUs from a bitmap. */
+static bool jailhouse_image_has_rt_cpu_set(void)
+{
+	const struct jailhouse_header *header = hv_image.head;
+
+	return jailhouse_header_ext(header, hv_image.head_size, 5) &&
+		   (header->flags & JAILHOUSE_HDR_RT_CPU_SET);
+}
+
+/* Returns true if the image supports node-local per-CPU areas. */
+static bool jailhouse_image_has_numa_percpu(void)
+{
+	const struct jailhouse_header *header = hv_image.head;
+
+	return jailhouse_header_ext(header, hv_image.head_size, 5) &&
+		   (header->flags & JAILHOUSE_HDR_NUMA_PERCPU);
 }
 
-static bool get_mem_region_one(
-	struct mem_region *region, const char *name, struct mem_region *reserved,
-	struct jailhouse_memory *regions, int *num)
+/* Returns true if the image follows CPU hotplug and CPU assignment. */
+static bool jailhouse_image_has_cpu_hotplug(void)
 {
-	unsigned long long flags = 0, l_start = 0, l_end = 0;
-	unsigned long long s = region->start;
-	unsigned long long e = s + region->size;
-	unsigned long long res_start = reserved->start;
-	unsigned long long res_end = res_start + reserved->size;
-	bool ok = true;
-	int l_index = 0;
+	const struct jailhouse_header *header = hv_image.head;
 
-	if (s == e)
+	return jailhouse_header_ext(header, hv_image.head_size, 6) &&
+		   (header->flags & JAILHOUSE_HDR_CPU_HOTPLUG);
+}
+
+/* Returns true if the image takes memory ballooned to the RT partition. */
+static bool jailhouse_image_has_mem_balloon(void)
+{
+	const struct jailhouse_header *header = hv_image.head;
+
+	return jailhouse_header_ext(header, hv_image.head_size, 7) &&
+		   (header->flags & JAILHOUSE_HDR_MEM_BALLOON);
+}
+
+/*
+ * Returns the page size the hypervisor and RT regions have to be mapped
+ * with according to JAILHOUSE_ENABLE_ALIGN_*, PAGE_SIZE if not requested.
+ */
+static unsigned long jailhouse_required_page_size(unsigned int flags)
+{
+	if (flags & JAILHOUSE_ENABLE_ALIGN_1G)
+		return PUD_SIZE;
+	if (flags & JAILHOUSE_ENABLE_ALIGN_2M)
+		return PMD_SIZE;
+	return PAGE_SIZE;
+}
+
+static int jailhouse_check_alignment(
+	const struct jailhouse_enable_args *args, unsigned long align)
+{
+	if (!IS_ALIGNED(args->hv_region.start, align) ||
+		!IS_ALIGNED(args->hv_region.size, align) ||
+		!IS_ALIGNED(args->rt_region.start, align) ||
+		!IS_ALIGNED(args->rt_region.size, align))
 	{
-		return true;
+		pr_err(
+			"jailhouse: hypervisor and RT regions must be aligned to "
+			"0x%lx\n",
+			align);
+		return -EINVAL;
 	}
+	return 0;
+}
+
+/*
+ * Memory the hypervisor gets: hv_size, or what it needs plus pool_size.
+ * The configuration is not built yet, so assume the most regions the iomem
+ * entries, their splits and the carved out regions can result in. The
+ * per-CPU memory is already carved out of @c num_iomem.
+ */
+static unsigned long long jailhouse_hv_needed(
+	const struct jailhouse_header *header, int num_iomem,
+	unsigned long page_size)
+{
+	struct jailhouse_topology topology = {
+		.num_nodes = nr_node_ids,
+		.num_cpus = num_possible_cpus(),
+	};
+	struct jailhouse_hv_layout_params params;
+	struct jailhouse_hv_layout layout;
+
+	if (hv_size[0])
+		return ALIGN(memparse(hv_size, NULL), page_size);
+
+	params.page_size = PAGE_SIZE;
+	params.features = jailhouse_header_features(header, hv_image.head_size);
+	params.max_cpus = num_possible_cpus();
+	params.core_size = header->core_size;
+	params.percpu_size = header->percpu_size;
+	params.config_size = jailhouse_system_config_bytes(
+		jailhouse_max_mem_regions(num_iomem, 0), &topology);
+	params.console_size = console_size;
+	jailhouse_hv_layout_init(&layout, &params);
+	return ALIGN(layout.end + pool_size, page_size);
+}
 
-	if (s <= res_start && res_end <= e)
+/*
+ * Shrink hv_region to jailhouse_hv_needed() and set hv_tail to the whole
+ * memory blocks behind it, which go back to Linux. Without such blocks, the
+ * hypervisor keeps the complete region unless hv_size is set. Blocks
+ * returned by a previous enable stay with Linux, unless hv_region moved
+ * away from them.
+ */
+static int jailhouse_size_hv_region(
+	const struct jailhouse_header *header, int num_iomem,
+	unsigned long page_size)
+{
+	const struct mem_region *plugged = jailhouse_hotplug_region();
+	unsigned long long end = hv_region.start + hv_region.size;
+	unsigned long block = jailhouse_hotplug_block_size();
+	unsigned long long needed;
+
+	hv_tail.size = 0;
+	if (plugged && plugged->start < end &&
+		hv_region.start < plugged->start + plugged->size)
 	{
-		if (strcmp(name, "Reserved"))
-		{
-			return false;
-		}
-		if (s < res_start)
-		{
-			region->start = s;
-			region->size = res_start - s;
-			ok = get_mem_region_one(region, name, reserved, regions, num);
-		}
-		if (ok && res_end < e)
+		if (plugged->start <= hv_region.start)
 		{
-			region->start = res_end;
-			region->size = e - res_end;
-			ok = get_mem_region_one(region, name, reserved, regions, num);
+			pr_err("jailhouse: hypervisor memory was returned to Linux\n");
+			return -EBUSY;
 		}
-		return ok;
+		hv_tail = *plugged;
+		hv_region.size = plugged->start - hv_region.start;
+		return 0;
 	}
-	else if (!(e <= res_start || res_end <= s))
+	/* only one range can be added, the hypervisor keeps the tail then */
+	if (plugged && jailhouse_hotplug_remove() == 0)
+		plugged = NULL;
+
+	needed = jailhouse_hv_needed(header, num_iomem, page_size);
+	if (needed > hv_region.size)
 	{
-		pr_err("overlapped with reserved region");
-		return false;
+		if (!hv_size[0])
+			return 0;
+		pr_err("jailhouse: hv_size exceeds the hypervisor memory\n");
+		return -EINVAL;
 	}
 
-	s = round_down(s, PAGE_SIZE);
-	e = round_up(e, PAGE_SIZE) - 1;
-	if ((*num) == 0)
+	if (return_unused && block && !plugged)
 	{
-		l_start = 0;
-		l_end = 0;
+		block = max(block, page_size);
+		hv_tail.start = ALIGN(hv_region.start + needed, block);
+		end = round_down(end, block);
+		if (hv_tail.start < end)
+		{
+			hv_tail.size = end - hv_tail.start;
+			hv_region.size = hv_tail.start - hv_region.start;
+			return 0;
+		}
 	}
-	else
-	{
-		l_index = (*num) - 1;
-		l_start = regions[l_index].phys_start;
-		l_end = regions[l_index].phys_start + regions[l_index].size - 1;
-	}
-	// check if current region is overlapped with last one
-	if (s < l_end)
-	{
-		pr_debug(
-			"overlap last:(0x%llx 0x%llx) now:(0x%llx 0x%llx)\n", l_start,
-			l_end, s, e);
-		s = min(s, l_start);
-		e = max(e, l_end);
-		// the flags of the merged regions should be OR of two flags of regions
-		// for example:  SYSRAM merge with RESERVED region, the merged.flags =
-		// SYSRAM.flags |  RESERVED.flags
-		flags = regions[l_index].flags;
-		(*num)--;
-	}
-
-	regions[*num].phys_start = s;
-	regions[*num].virt_start = s;
-	regions[*num].size = e - s + 1;
-	regions[*num].flags = flags | mem_region_flag(name);
-	pr_debug(
-		"add region %d: %s [0x%llx..0x%llx] 0x%llx\n", *num, name,
-		regions[*num].phys_start,
-		regions[*num].phys_start + regions[*num].size - 1, regions[*num].flags);
-	(*num)++;
-
-	return true;
+	if (hv_size[0])
+		hv_region.size = needed;
+	return 0;
 }
 
 /*
- * get_mem_regions - Get the memory regions reported to hypervisor.
- *
- * The start and end addr of memory regions must be PAGE_SIZE align.
+ * Allocate hv_region, and rt_region if it has a size, from CMA if enable
+ * passed them without a start address, aligned for huge pages. The size of
+ * hv_region defaults to jailhouse_hv_needed().
  */
-static int
-get_mem_regions(struct jailhouse_memory *regions, struct mem_region *reserved)
+static int jailhouse_cma_alloc_regions(
+	const struct jailhouse_header *header, int num_iomem,
+	unsigned long page_size)
 {
-	int num = 0;
-	struct resource *child = iomem_resource.child;
+	unsigned long align = max_t(unsigned long, page_size, PMD_SIZE);
+	int err;
 
-	while (child)
+	if (!hv_region.start)
+	{
+		if (!hv_region.size)
+			hv_region.size = jailhouse_hv_needed(header, num_iomem, page_size);
+		err = jailhouse_cma_alloc(&hv_region, hv_region.size, align);
+		if (err)
+			return err;
+		hv_region_cma = true;
+	}
+	if (!rt_region.start && rt_region.size)
 	{
-		struct mem_region region;
-		region.start = child->start;
-		region.size = child->end - child->start + 1;
-		pr_debug(
-			"found region: %s [0x%llx..0x%llx]\n", child->name, region.start,
-			region.start + region.size - 1);
-		if (!get_mem_region_one(&region, child->name, reserved, regions, &num))
+		err = jailhouse_cma_alloc(&rt_region, rt_region.size, align);
+		if (err)
 		{
-			return -1;
+			jailhouse_cma_free_regions();
+			return err;
 		}
-		child = child->sibling;
+		rt_region_cma = true;
 	}
-	return num;
+	return 0;
 }
 
 /*
- * Dump hypervisor memory region and all memory regions reported to hypervisor.
+ * Select the RT CPUs as requested by req. Hypervisors without
+ * JAILHOUSE_HDR_RT_CPU_SET expect them to be the last rt_cpus CPUs.
  */
-static void dump_mem_regions(struct jailhouse_memory *regions, int n)
+static int select_rt_cpus(const struct jailhouse_enable_request *req)
 {
-	int i;
-	for (i = 0; i < n; i++)
+	const struct jailhouse_enable_args *args = &req->args;
+	unsigned int policy = args->flags & (JAILHOUSE_ENABLE_RT_ISOLATE_SMT |
+										 JAILHOUSE_ENABLE_RT_ISOLATE_LLC);
+	unsigned int cpu;
+	int err;
+
+	err = jailhouse_rt_cpus_select(
+		args->rt_cpu_set ? req->rt_cpu_set : NULL, args->rt_cpus ?: 1, policy,
+		&rt_cpus_mask, &parked_cpus_mask);
+	if (err)
 	{
-		pr_info(
-			"region[%d]: [0x%llx - 0x%llx], size=0x%llx, flag=0x%llx\n", i,
-			regions[i].phys_start, regions[i].phys_start + regions[i].size - 1,
-			regions[i].size, regions[i].flags);
+		pr_err("jailhouse: cannot isolate the requested RT CPUs\n");
+		return err;
 	}
+
+	rt_cpus = cpumask_weight(&rt_cpus_mask);
+	if (!rt_cpus || cpumask_last(&rt_cpus_mask) >= max_cpus)
+		return -EINVAL;
+	if (!jailhouse_image_has_rt_cpu_set())
+		for (cpu = max_cpus - rt_cpus; cpu < max_cpus; cpu++)
+			if (!cpumask_test_cpu(cpu, &rt_cpus_mask))
+			{
+				pr_err(
+					"jailhouse: hypervisor only supports the last %u CPUs "
+					"as RT CPUs\n",
+					rt_cpus);
+				return -EINVAL;
+			}
+
+	pr_info(
+		"jailhouse: RT CPUs %*pbl, parked CPUs %*pbl\n",
+		cpumask_pr_args(&rt_cpus_mask), cpumask_pr_args(&parked_cpus_mask));
+	return 0;
 }
 
-static void init_system_config(
-	struct jailhouse_system *config, struct mem_region *hv_region,
-	struct mem_region *rt_region, int num_mem_regions,
-	struct jailhouse_memory *mem_regions)
+/* Take the RT and parked CPUs away from Linux. */
+static int offline_rt_cpus(void)
 {
-	memset(config, 0, sizeof(*config));
-
-	memcpy(
-		config->signature, JAILHOUSE_SYSTEM_SIGNATURE,
-		sizeof(config->signature));
-	config->revision = JAILHOUSE_CONFIG_REVISION;
-	config->hypervisor_memory.phys_start = hv_region->start;
-	config->hypervisor_memory.size = hv_region->size;
-	config->rtos_memory.phys_start = rt_region->start;
-	config->rtos_memory.size = rt_region->size;
-	memcpy(
-		config->root_cell.signature, JAILHOUSE_CELL_DESC_SIGNATURE,
-		sizeof(config->root_cell.signature));
-	config->root_cell.revision = JAILHOUSE_CONFIG_REVISION;
-	strcpy(config->root_cell.name, "linux-root-cell");
-	config->root_cell.id = 0;
-	config->root_cell.num_memory_regions = num_mem_regions;
+	unsigned int cpu;
+	int err;
 
-	memcpy(
-		(void *)config + sizeof(*config), mem_regions,
-		sizeof(*mem_regions) * num_mem_regions);
+	WRITE_ONCE(rt_cpus_taken, true);
+	for_each_cpu(cpu, &rt_cpus_mask)
+	{
+		err = cpu_down(cpu);
+		if (err)
+			return err;
+	}
+	for_each_cpu(cpu, &parked_cpus_mask)
+	{
+		err = cpu_down(cpu);
+		if (err)
+			return err;
+	}
+	return 0;
 }
 
-/* See Documentation/bootstrap-interface.txt */
-static int jailhouse_cmd_enable(struct jailhouse_enable_args __user *arg)
+/* Give the RT and parked CPUs back to Linux. */
+static void online_rt_cpus(void)
 {
-	const struct firmware *hypervisor;
-	struct jailhouse_system *config;
-	struct jailhouse_header *header;
-	unsigned long remap_addr = 0;
-	unsigned long config_size;
-	const char *fw_name;
 	unsigned int cpu;
-	int err;
 
-	int num_iomem, num_mem_regions;
-	struct jailhouse_memory *mem_regions;
+	WRITE_ONCE(rt_cpus_taken, false);
+	for_each_cpu(cpu, &rt_cpus_mask)
+		cpu_up(cpu);
+	for_each_cpu(cpu, &parked_cpus_mask)
+		cpu_up(cpu);
+}
+
+/* Open the hypercall rings, or direct calls, to jailhouse_hc_submit(). */
+static void start_hc_rings(void)
+{
+	jailhouse_hc_ring_start(
+		hc_ring_offset ? hypervisor_mem + hc_ring_offset : NULL, max_cpus);
+}
+
+static void jailhouse_enable_request_free(struct jailhouse_enable_request *req)
+{
+	if (req->eventfd)
+		eventfd_ctx_put(req->eventfd);
+	free_cpumask_var(req->rt_cpu_set);
+	kfree(req);
+}
+
+/*
+ * Take the arguments of JAILHOUSE_ENABLE from the caller and check what
+ * can be checked without the lock, so that an asynchronous enable does not
+ * touch userspace and fails early on bad arguments.
+ */
+static int jailhouse_enable_request_init(
+	struct jailhouse_enable_request *req,
+	struct jailhouse_enable_args __user *arg)
+{
+	struct jailhouse_enable_args *args = &req->args;
+	int err;
 
-	fw_name = jailhouse_get_fw_name();
-	if (!fw_name)
+	req->fw_name = jailhouse_get_fw_name();
+	if (!req->fw_name)
 	{
 		pr_err("jailhouse: Missing or unsupported HVM technology\n");
 		return -ENODEV;
 	}
 
-	if (copy_from_user(&hv_region, &arg->hv_region, sizeof(struct mem_region)))
+	if (copy_from_user(args, arg, sizeof(*args)))
 	{
 		pr_err("jailhouse_cmd_enable: invalid arg: 0x%p\n", arg);
 		return -EFAULT;
 	}
-	if (copy_from_user(&rt_region, &arg->rt_region, sizeof(struct mem_region)))
+	if (args->hv_region.start && !args->hv_region.size)
 	{
-		pr_err("jailhouse_cmd_enable: invalid arg: 0x%p\n", arg);
-		return -EFAULT;
+		args->hv_region.size = 256 << 20; // 256M
+		pr_notice(
+			"jailhouse: no hypervisor memory size given, assuming 256 "
+			"MiB\n");
 	}
-	if (!hv_region.size)
+	req->page_size = jailhouse_required_page_size(args->flags);
+	err = jailhouse_check_alignment(args, req->page_size);
+	if (err)
+		return err;
+
+	if (!zalloc_cpumask_var(&req->rt_cpu_set, GFP_KERNEL))
+		return -ENOMEM;
+	if (args->rt_cpu_set &&
+		copy_from_user(
+			cpumask_bits(req->rt_cpu_set), u64_to_user_ptr(args->rt_cpu_set),
+			min_t(size_t, args->rt_cpu_set_size, cpumask_size())))
+		return -EFAULT;
+
+	if (args->flags & JAILHOUSE_ENABLE_EVENTFD)
 	{
-		hv_region.size = 256 << 20; // 256M
+		req->eventfd = eventfd_ctx_fdget(args->eventfd);
+		if (IS_ERR(req->eventfd))
+		{
+			err = PTR_ERR(req->eventfd);
+			req->eventfd = NULL;
+			return err;
+		}
 	}
+	return 0;
+}
+
+/* See Documentation/bootstrap-interface.txt */
+static int jailhouse_enable_attempt(const struct jailhouse_enable_request *req)
+{
+	const struct jailhouse_enable_args *args = &req->args;
+	unsigned long page_size = req->page_size;
+	struct jailhouse_populate_range *populate;
+	struct jailhouse_system *config;
+	struct jailhouse_header *header;
+	unsigned long remap_addr = 0;
+	struct jailhouse_hv_layout_params layout_params;
+	struct jailhouse_hv_layout layout;
+	unsigned long config_size, config_end;
+	unsigned int num_populate;
+	ssize_t image_size;
+	bool warm, copy_image;
+	u64 config_hash;
+	int err;
+
+	int num_iomem, num_mem_regions;
+	struct jailhouse_memory *mem_regions, *opt_regions;
+	struct jailhouse_layout_stats layout_stats;
+	struct jailhouse_topology topology;
+	struct jailhouse_iomem_entry *iomem;
 
 	if (mutex_lock_interruptible(&jailhouse_lock) != 0)
 		return -EINTR;
 
+	jailhouse_phase_begin(JAILHOUSE_PHASE_ENABLE);
+
 	err = -EBUSY;
 	if (jailhouse_enabled || !try_module_get(THIS_MODULE))
 		goto error_unlock;
 
+	/* retry freeing an rt_region the kernel mapped at disable time */
+	jailhouse_cma_free_regions();
+	if (rt_region_cma)
+		goto error_put_module;
+
+	hv_region = args->hv_region;
+	rt_region = args->rt_region;
+
 #ifdef CONFIG_X86
 	if (boot_cpu_has(X86_FEATURE_VMX))
 	{
@@ -451,104 +946,291 @@ static int jailhouse_cmd_enable(struct jailhouse_enable_args __user *arg)
 #endif
 
 	/* Load hypervisor image */
-	err = request_firmware(&hypervisor, fw_name, jailhouse_dev);
+	jailhouse_phase_begin(JAILHOUSE_PHASE_FW_LOAD);
+	err = jailhouse_get_firmware(
+		req->fw_name, args->flags & JAILHOUSE_ENABLE_RELOAD);
+	jailhouse_phase_end(JAILHOUSE_PHASE_FW_LOAD, err);
 	if (err)
-	{
-		pr_err("jailhouse: Missing hypervisor image %s\n", fw_name);
 		goto error_put_module;
-	}
+	header = hv_image.head;
+
+	max_cpus = num_possible_cpus();
+	err = select_rt_cpus(req);
+	if (err)
+		goto error_put_module;
+
+	/* The per-CPU memory is carved out of the root cell below. */
+	err = jailhouse_numa_topology_init(&topology, max_cpus);
+	if (err)
+		goto error_put_module;
+	percpu_node_local =
+		numa_percpu && jailhouse_image_has_numa_percpu() &&
+		!jailhouse_numa_percpu_alloc(&topology, header->percpu_size);
 
 	/* Get memory regions */
-	num_iomem = get_iomem_num();
-	mem_regions = kvmalloc(sizeof(*mem_regions) * num_iomem, GFP_KERNEL);
+	jailhouse_phase_begin(JAILHOUSE_PHASE_MEM_REGIONS);
+	num_iomem = get_iomem_entries(&iomem);
+	if (num_iomem < 0)
+	{
+		err = num_iomem;
+		jailhouse_phase_end(JAILHOUSE_PHASE_MEM_REGIONS, err);
+		goto error_free_topology;
+	}
+	if (percpu_node_local)
+		num_iomem = jailhouse_numa_percpu_carve(iomem, num_iomem);
+	err = jailhouse_cma_alloc_regions(header, num_iomem, page_size);
+	if (!err && !hv_region_cma)
+		err = jailhouse_size_hv_region(header, num_iomem, page_size);
+	if (err)
+	{
+		kvfree(iomem);
+		jailhouse_phase_end(JAILHOUSE_PHASE_MEM_REGIONS, err);
+		goto error_free_topology;
+	}
+	/* The root cell gets returned memory as RAM, but no access to the
+	 * hypervisor memory taken from RAM. */
+	if (hv_tail.size)
+		num_iomem =
+			jailhouse_iomem_carve(iomem, num_iomem, &hv_tail, "System RAM");
+	else if (hv_region_cma)
+		num_iomem =
+			jailhouse_iomem_carve(iomem, num_iomem, &hv_region, "Reserved");
+	/* one more since the region containing hv_region gets split */
+	mem_regions =
+		kvmalloc_array(num_iomem + 1, sizeof(*mem_regions), GFP_KERNEL);
 	if (!mem_regions)
 	{
+		kvfree(iomem);
 		err = -ENOMEM;
-		goto error_release_fw;
+		jailhouse_phase_end(JAILHOUSE_PHASE_MEM_REGIONS, err);
+		goto error_free_topology;
 	}
-	num_mem_regions = get_mem_regions(mem_regions, &hv_region);
+	num_mem_regions = jailhouse_get_mem_regions(
+		iomem, num_iomem, &hv_region, mem_regions);
+	kvfree(iomem);
 	if (num_mem_regions == -1)
 	{
 		err = -EINVAL;
+		jailhouse_phase_end(JAILHOUSE_PHASE_MEM_REGIONS, err);
 		pr_err("hypervisor memory is overlapped with other memory regions\n");
 		goto error_free_mem_regions;
 	}
+	if (optimize_layout)
+	{
+		opt_regions = kvmalloc_array(
+			num_mem_regions * JAILHOUSE_MEM_REGION_MAX_SPLIT,
+			sizeof(*opt_regions), GFP_KERNEL);
+		if (!opt_regions)
+		{
+			err = -ENOMEM;
+			jailhouse_phase_end(JAILHOUSE_PHASE_MEM_REGIONS, err);
+			goto error_free_mem_regions;
+		}
+		num_mem_regions = jailhouse_optimize_mem_regions(
+			mem_regions, num_mem_regions, opt_regions, &layout_stats);
+		kvfree(mem_regions);
+		mem_regions = opt_regions;
+		pr_info(
+			"jailhouse: root cell layout: %d -> %d (%d coalesced) regions, "
+			"~%llu -> ~%llu stage-2 entries\n",
+			layout_stats.regions_before, layout_stats.regions_after,
+			layout_stats.regions_coalesced, layout_stats.entries_before,
+			layout_stats.entries_after);
+	}
+	jailhouse_phase_end(JAILHOUSE_PHASE_MEM_REGIONS, 0);
 	dump_mem_regions(mem_regions, num_mem_regions);
 
-	pr_err(
-		"hypervisor memory region: [0x%llx-0x%llx], 0x%llx\n", hv_region.start,
-		hv_region.start + hv_region.size - 1, hv_region.size);
-	pr_err(
-		"RT memory region: [0x%llx-0x%llx], 0x%llx\n", rt_region.start,
-		rt_region.start + rt_region.size - 1, rt_region.size);
-
-	header = (struct jailhouse_header *)hypervisor->data;
+	pr_debug(
+		"jailhouse: hypervisor memory region: [0x%llx-0x%llx], 0x%llx\n",
+		hv_region.start, hv_region.start + hv_region.size - 1,
+		hv_region.size);
+	pr_debug(
+		"jailhouse: RT memory region: [0x%llx-0x%llx], 0x%llx\n",
+		rt_region.start, rt_region.start + rt_region.size - 1,
+		rt_region.size);
 
 	err = -EINVAL;
-	if (memcmp(
-			header->signature, JAILHOUSE_SIGNATURE,
-			sizeof(header->signature)) != 0)
-	{
-		pr_err("SIGNATURE CHECK FAIL\n");
-		goto error_release_fw;
-	}
-
-	max_cpus = num_possible_cpus();
-	rt_cpus = 1;
-	hv_core_and_percpu_size =
-		header->core_size + max_cpus * header->percpu_size;
-	config_size = sizeof(*config) + num_mem_regions * sizeof(*mem_regions);
+	hv_core_and_percpu_size = header->core_size;
+	if (!percpu_node_local)
+		hv_core_and_percpu_size += max_cpus * header->percpu_size;
+	config_size = jailhouse_system_config_bytes(num_mem_regions, &topology);
 	if (hv_core_and_percpu_size >= hv_region.size ||
 		config_size >= hv_region.size - hv_core_and_percpu_size)
 		goto error_free_mem_regions;
 
-	remap_addr = JAILHOUSE_BASE;
-
-	/* Unmap hypervisor_mem from a previous "enable". The mapping has to be
-	 * redone since the root-cell config might have changed. */
-	jailhouse_firmware_free();
+	/* The areas shared with the hypervisor follow the system
+	 * configuration. The tool sizes hv_region with the same layout. */
+	layout_params.page_size = PAGE_SIZE;
+	layout_params.features =
+		jailhouse_header_features(header, hv_image.head_size);
+	layout_params.max_cpus = max_cpus;
+	layout_params.core_size = header->core_size;
+	layout_params.percpu_size = percpu_node_local ? 0 : header->percpu_size;
+	layout_params.config_size = config_size;
+	layout_params.console_size = console_size;
+	jailhouse_hv_layout_init(&layout, &layout_params);
+	hc_ring_offset = layout.hc_ring_offset;
+	stats_offset = layout.stats_offset;
+	console_offset = layout.console_offset;
+	console_area_size = layout.console_area_size;
+	rt_cpu_set_offset = layout.rt_cpu_set_offset;
+	if (layout.end > hv_region.size)
+		goto error_free_mem_regions;
 
-	hypervisor_mem_res =
-		request_mem_region(hv_region.start, hv_region.size, "EVM hypervisor");
-	if (!hypervisor_mem_res)
+	/* Generate the system configuration, it is only copied into the
+	 * hypervisor memory if it differs from the one already there. */
+	jailhouse_phase_begin(JAILHOUSE_PHASE_CONFIG);
+	config = kvmalloc(config_size, GFP_KERNEL);
+	if (!config)
 	{
-		pr_err("jailhouse: request_mem_region failed for hypervisor "
-			   "memory.\n");
-		pr_notice("jailhouse: Did you reserve the memory with "
-				  "\"memmap=\" or \"mem=\"?\n");
+		err = -ENOMEM;
+		jailhouse_phase_end(JAILHOUSE_PHASE_CONFIG, err);
 		goto error_free_mem_regions;
 	}
+	jailhouse_init_system_config(
+		config, &hv_region, &rt_region, num_mem_regions, mem_regions,
+		&topology);
+	jailhouse_numa_topology_free(&topology);
+	config_hash = xxh64(config, config_size, 0);
+	jailhouse_phase_end(JAILHOUSE_PHASE_CONFIG, 0);
 
-	/* Map physical memory region reserved for Jailhouse. */
-	hypervisor_mem =
-		jailhouse_ioremap(hv_region.start, remap_addr, hv_region.size);
-	if (!hypervisor_mem)
-	{
-		pr_err(
-			"jailhouse: Unable to map RAM reserved for hypervisor at %08lx\n",
-			(unsigned long)hv_region.start);
-		goto error_release_memreg;
+	remap_addr = JAILHOUSE_BASE;
+
+	/* Keep the mapping of a previous "enable" if it covers the same
+	 * region, otherwise unmap and redo it. */
+	warm = hypervisor_mem && mapped_region.start == hv_region.start &&
+		   mapped_region.size == hv_region.size;
+
+	jailhouse_phase_begin(JAILHOUSE_PHASE_IOREMAP);
+	if (!warm)
+	{
+		jailhouse_firmware_free();
+
+		/* memory from CMA is owned by the driver already */
+		hypervisor_mem_res = NULL;
+		if (!hv_region_cma)
+			hypervisor_mem_res = request_mem_region(
+				hv_region.start, hv_region.size, "EVM hypervisor");
+		if (!hv_region_cma && !hypervisor_mem_res)
+		{
+			pr_err("jailhouse: request_mem_region failed for hypervisor "
+				   "memory.\n");
+			pr_notice("jailhouse: Did you reserve the memory with "
+					  "\"memmap=\" or \"mem=\"?\n");
+			jailhouse_phase_end(JAILHOUSE_PHASE_IOREMAP, err);
+			goto error_free_config;
+		}
+
+		/* Map physical memory region reserved for Jailhouse. */
+		hypervisor_mem =
+			jailhouse_ioremap(hv_region.start, remap_addr, hv_region.size);
+		if (!hypervisor_mem)
+		{
+			pr_err(
+				"jailhouse: Unable to map RAM reserved for hypervisor at "
+				"%08lx\n",
+				(unsigned long)hv_region.start);
+			jailhouse_phase_end(JAILHOUSE_PHASE_IOREMAP, err);
+			goto error_release_memreg;
+		}
+		mapped_region = hv_region;
+		hv_mappings_synced = jailhouse_sync_kernel_mappings(
+			(unsigned long)hypervisor_mem,
+			(unsigned long)hypervisor_mem + hv_region.size);
+		pr_info(
+			"jailhouse: hypervisor memory mapped with %lu PUD, %lu PMD, "
+			"%lu PTE entries\n",
+			jailhouse_map_stats.pud, jailhouse_map_stats.pmd,
+			jailhouse_map_stats.pte);
+	}
+	if ((page_size >= PMD_SIZE && jailhouse_map_stats.pte) ||
+		(page_size >= PUD_SIZE && jailhouse_map_stats.pmd))
+	{
+		pr_err(
+			"jailhouse: hypervisor memory could not be mapped with "
+			"0x%lx pages\n",
+			page_size);
+		jailhouse_phase_end(JAILHOUSE_PHASE_IOREMAP, err);
+		goto error_unmap;
 	}
+	jailhouse_phase_end(JAILHOUSE_PHASE_IOREMAP, 0);
 
-	pr_err("hypervisor_mem: 0x%lx\n", (unsigned long)hypervisor_mem);
+	pr_debug(
+		"jailhouse: hypervisor_mem: 0x%lx\n", (unsigned long)hypervisor_mem);
 
 	/* Copy hypervisor's binary image at beginning of the memory region
-	 * and clear the rest to zero. */
-	memcpy(hypervisor_mem, hypervisor->data, hypervisor->size);
-	memset(
-		hypervisor_mem + hypervisor->size, 0,
-		hv_region.size - hypervisor->size);
+	 * and clear what has to be zero. A re-entrant image that is already
+	 * in place is left alone. */
+	jailhouse_phase_begin(JAILHOUSE_PHASE_COPY);
+	copy_image = !warm || !jailhouse_image_reusable();
+	if (copy_image)
+	{
+		image_size = jailhouse_image_load(
+			&hv_image, hypervisor_mem, hv_region.size, jailhouse_dev);
+		if (image_size < 0)
+		{
+			err = image_size;
+			jailhouse_phase_end(JAILHOUSE_PHASE_COPY, err);
+			goto error_unmap;
+		}
+		populate = kcalloc(max_cpus + 1, sizeof(*populate), GFP_KERNEL);
+		if (!populate)
+		{
+			err = -ENOMEM;
+			jailhouse_phase_end(JAILHOUSE_PHASE_COPY, err);
+			goto error_unmap;
+		}
+		num_populate = get_populate_ranges(header, image_size, populate);
+		jailhouse_populate(populate, num_populate);
+		kfree(populate);
+		loaded_image_gen = hv_image.generation;
+		loaded_config_hash = 0;
+	}
+	else
+		pr_info("jailhouse: warm enable, reusing the loaded image\n");
+
+	/* Copy system configuration to its target address in hypervisor memory
+	 * region. */
+	if (config_hash != loaded_config_hash)
+	{
+		config_end = hv_core_and_percpu_size + config_size;
+		memcpy(hypervisor_mem + hv_core_and_percpu_size, config, config_size);
+		memset(
+			hypervisor_mem + config_end, 0,
+			PAGE_ALIGN(config_end) - config_end);
+		loaded_config_hash = config_hash;
+	}
+	jailhouse_phase_end(JAILHOUSE_PHASE_COPY, 0);
 
 	header = (struct jailhouse_header *)hypervisor_mem;
 	header->max_cpus = max_cpus;
 	header->rt_cpus = rt_cpus;
-
-	/* Copy system configuration to its target address in hypervisor memory
-	 * region. */
-	config =
-		(struct jailhouse_system *)(hypervisor_mem + hv_core_and_percpu_size);
-	init_system_config(
-		config, &hv_region, &rt_region, num_mem_regions, mem_regions);
+	if (hc_ring_offset)
+	{
+		jailhouse_hc_ring_init(hypervisor_mem + hc_ring_offset, max_cpus);
+		header->hc_ring_offset = hc_ring_offset;
+	}
+	if (stats_offset)
+	{
+		memset(
+			hypervisor_mem + stats_offset, 0,
+			max_cpus * sizeof(struct jailhouse_cpu_stats));
+		header->stats_offset = stats_offset;
+	}
+	if (console_offset)
+	{
+		jailhouse_console_setup(
+			hypervisor_mem + console_offset, console_area_size);
+		header->console_offset = console_offset;
+		header->console_size = console_area_size;
+	}
+	if (rt_cpu_set_offset)
+	{
+		bitmap_copy(
+			hypervisor_mem + rt_cpu_set_offset, cpumask_bits(&rt_cpus_mask),
+			max_cpus);
+		header->rt_cpu_set_offset = rt_cpu_set_offset;
+	}
 
 	/*
 	 * ARMv8 requires to clean D-cache and invalidate I-cache for memory
@@ -556,52 +1238,98 @@ static int jailhouse_cmd_enable(struct jailhouse_enable_args __user *arg)
 	 * firmware does its own cache maintenance, so it is an
 	 * extraneous (but harmless) flush.
 	 */
-	flush_icache_range(
-		(unsigned long)hypervisor_mem,
-		(unsigned long)(hypervisor_mem + header->core_size));
+	jailhouse_phase_begin(JAILHOUSE_PHASE_FLUSH_ICACHE);
+	if (copy_image)
+		flush_icache_range(
+			(unsigned long)hypervisor_mem,
+			(unsigned long)(hypervisor_mem + header->core_size));
+	jailhouse_phase_end(JAILHOUSE_PHASE_FLUSH_ICACHE, 0);
+
+	/* A stand-in's entry() doubles as its hypercall stub. */
+	jailhouse_standin_call = NULL;
+	if (jailhouse_image_is_standin())
+	{
+		pr_info("jailhouse: entering stand-in image\n");
+		jailhouse_standin_call =
+			(void *)((unsigned long)header->entry +
+					 (unsigned long)hypervisor_mem);
+	}
 
-	error_code = 0;
+	err = offline_rt_cpus();
+	if (err)
+	{
+		pr_err("jailhouse: failed to offline the RT CPUs: %d\n", err);
+		goto err_add_rt_cpus;
+	}
 
+	/* CPUs coming or going now would miss the rendezvous */
+	cpus_read_lock();
 	preempt_disable();
 
-	cpumask_clear(&vm_cpus_mask);
-	for (cpu = 0; cpu < max_cpus; cpu++)
-	{
-		// if (cpu >= max_cpus - rt_cpus) {
-		// 	cpu_down(cpu);
-		// } else {
-		cpumask_set_cpu(cpu, &vm_cpus_mask);
-		// }
-	}
-	pr_err(
-		"Before entering hypervisor: max_cpus=%d, rt_cpus=%d, "
+	cpumask_copy(&vm_cpus_mask, cpu_online_mask);
+	pr_debug(
+		"jailhouse: before entering hypervisor: max_cpus=%d, rt_cpus=%d, "
 		"num_online_cpus=%d\n",
 		max_cpus, rt_cpus, num_online_cpus());
 
 	/*
-	 * Cannot use wait=true here because all CPUs have to enter the
-	 * hypervisor to start the handover while on_each_cpu holds the calling
-	 * CPU back.
+	 * All CPUs have to enter the hypervisor to start the handover, so the
+	 * calling CPU enters last, after kicking the others.
 	 */
-	atomic_set(&call_done, 0);
-	on_each_cpu_mask(&vm_cpus_mask, enter_hypervisor, header, 0);
-	while (atomic_read(&call_done) != num_online_cpus())
-		cpu_relax();
+	jailhouse_phase_begin(JAILHOUSE_PHASE_ENTER);
+	err = jailhouse_rendezvous(&vm_cpus_mask, enter_hypervisor, header);
+	jailhouse_phase_end(JAILHOUSE_PHASE_ENTER, err);
 
 	preempt_enable();
+	if (!err)
+		cpuhp_follow = jailhouse_image_has_cpu_hotplug();
+	cpus_read_unlock();
 
-	if (error_code)
+	if (err == -ETIMEDOUT)
 	{
-		err = error_code;
-		goto err_add_rt_cpus;
+		/*
+		 * Stragglers may still run in the hypervisor memory, so it must
+		 * stay mapped and the module loaded.
+		 */
+		pr_crit(
+			"jailhouse: CPUs stuck entering the hypervisor, reboot to "
+			"recover\n");
+		kvfree(config);
+		kvfree(mem_regions);
+		goto error_unlock;
 	}
+	if (err)
+		goto err_add_rt_cpus;
 
+	kvfree(config);
 	kvfree(mem_regions);
-	release_firmware(hypervisor);
 
-	enter_hv_cpus = atomic_read(&call_done);
 	jailhouse_enabled = true;
+	start_hc_rings();
+	if (stats_offset)
+		jailhouse_sysfs_stats_start(
+			hypervisor_mem + stats_offset, max_cpus);
+	if (console_offset)
+		jailhouse_console_start(
+			hypervisor_mem + console_offset, hv_region.start + console_offset,
+			console_area_size);
+
+	/* Linux can use the memory as soon as it is onlined. */
+	if (hv_tail.size && !jailhouse_hotplug_region())
+	{
+		err = jailhouse_hotplug_add(&hv_tail);
+		if (err)
+			pr_warn(
+				"jailhouse: returning [0x%llx-0x%llx] to Linux failed: %d\n",
+				hv_tail.start, hv_tail.start + hv_tail.size - 1, err);
+		else
+			pr_info(
+				"jailhouse: returned %llu MiB of hypervisor memory to "
+				"Linux\n",
+				hv_tail.size >> 20);
+	}
 
+	jailhouse_phase_end(JAILHOUSE_PHASE_ENABLE, 0);
 	mutex_unlock(&jailhouse_lock);
 
 	pr_info("The Jailhouse is opening.\n");
@@ -609,14 +1337,10 @@ static int jailhouse_cmd_enable(struct jailhouse_enable_args __user *arg)
 	return 0;
 
 err_add_rt_cpus:
-	for (cpu = 0; cpu < max_cpus; cpu++)
-	{
-		if (cpu >= max_cpus - rt_cpus)
-		{
-			cpu_up(cpu);
-		}
-	}
+	jailhouse_standin_call = NULL;
+	online_rt_cpus();
 
+error_unmap:
 	jailhouse_firmware_free();
 
 error_release_memreg:
@@ -627,40 +1351,149 @@ error_release_memreg:
 			hypervisor_mem_res->start, resource_size(hypervisor_mem_res));
 	hypervisor_mem_res = NULL;
 
+error_free_config:
+	kvfree(config);
+
 error_free_mem_regions:
 	kvfree(mem_regions);
 
-error_release_fw:
-	release_firmware(hypervisor);
+error_free_topology:
+	jailhouse_numa_topology_free(&topology);
+	jailhouse_numa_percpu_free();
 
 error_put_module:
+	jailhouse_cma_free_regions();
 	module_put(THIS_MODULE);
 
 error_unlock:
+	jailhouse_phase_end(JAILHOUSE_PHASE_ENABLE, err);
 	mutex_unlock(&jailhouse_lock);
 	return err;
 }
 
-static void leave_hypervisor(void *info)
+/*
+ * The memory layout follows the image header, so an image replaced while
+ * it was loaded takes a new attempt from the probe on.
+ */
+static int jailhouse_enable(const struct jailhouse_enable_request *req)
 {
-	void *page;
+	unsigned int attempts = 3;
 	int err;
 
-	/* Touch each hypervisor page we may need during the switch so that
-	 * the active mm definitely contains all mappings. At least x86 does
-	 * not support taking any faults while switching worlds. */
-	for (page = hypervisor_mem; page < hypervisor_mem + hv_core_and_percpu_size;
-		 page += PAGE_SIZE)
-		readl((void __iomem *)page);
+	do
+		err = jailhouse_enable_attempt(req);
+	while (err == -ESTALE && --attempts);
+	return err;
+}
+
+/* Start tracking a new enable, -EBUSY while one is still running. */
+static int jailhouse_enable_status_start(void)
+{
+	int err = 0;
+
+	spin_lock(&enable_status_lock);
+	if (enable_status.state == JAILHOUSE_ENABLE_RUNNING)
+		err = -EBUSY;
+	else
+	{
+		memset(
+			enable_status.phase_result, 0, sizeof(enable_status.phase_result));
+		memset(enable_status.phase_nsec, 0, sizeof(enable_status.phase_nsec));
+		enable_status.state = JAILHOUSE_ENABLE_RUNNING;
+		enable_status.result = 0;
+		enable_status.phase = JAILHOUSE_PHASE_ENABLE;
+		enable_status.seq++;
+	}
+	spin_unlock(&enable_status_lock);
+	return err;
+}
+
+/* Report the result of an enable to the pollers and its eventfd. */
+static void jailhouse_enable_done(struct jailhouse_enable_request *req, int err)
+{
+	spin_lock(&enable_status_lock);
+	enable_status.state = JAILHOUSE_ENABLE_DONE;
+	enable_status.result = err;
+	spin_unlock(&enable_status_lock);
+
+	wake_up_interruptible_all(&enable_wait);
+	if (req->eventfd)
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 8, 0)
+		eventfd_signal(req->eventfd);
+#else
+		eventfd_signal(req->eventfd, 1);
+#endif
+	jailhouse_enable_request_free(req);
+}
+
+static void jailhouse_enable_work_fn(struct work_struct *work)
+{
+	struct jailhouse_enable_request *req = enable_queued;
 
-	/* either returns 0 or the same error code across all CPUs */
-	err = jailhouse_call(JAILHOUSE_HC_DISABLE);
+	enable_queued = NULL;
+	jailhouse_enable_done(req, jailhouse_enable(req));
+}
+
+/*
+ * Enable in the caller's context, or with JAILHOUSE_ENABLE_ASYNC on
+ * enable_work, which only one enable can be queued to at a time.
+ */
+static int jailhouse_cmd_enable(struct jailhouse_enable_args __user *arg)
+{
+	struct jailhouse_enable_request *req;
+	int err;
+
+	req = kzalloc(sizeof(*req), GFP_KERNEL);
+	if (!req)
+		return -ENOMEM;
+	err = jailhouse_enable_request_init(req, arg);
+	if (!err)
+		err = jailhouse_enable_status_start();
 	if (err)
-		error_code = err;
+	{
+		jailhouse_enable_request_free(req);
+		return err;
+	}
+
+	if (req->args.flags & JAILHOUSE_ENABLE_ASYNC)
+	{
+		enable_queued = req;
+		queue_work(system_unbound_wq, &enable_work);
+		return 0;
+	}
+
+	err = jailhouse_enable(req);
+	jailhouse_enable_done(req, err);
+	return err;
+}
+
+/* Leave the hypervisor on the calling CPU through hypercall num. */
+static int leave_hypervisor_call(__u32 num)
+{
+	unsigned int cpu = smp_processor_id();
+	void *page;
+	int err;
+
+	trace_jailhouse_cpu_begin(cpu, JAILHOUSE_PHASE_LEAVE);
+
+	/* The active mm must contain all mappings we may need during the
+	 * switch, at least x86 does not support taking any faults while
+	 * switching worlds. Normally this was guaranteed once at enable time.
+	 * Otherwise touch the region once per top-level entry - only those
+	 * can be missing, the lower levels are shared. */
+	if (!hv_mappings_synced)
+		for (page = hypervisor_mem;
+			 page < hypervisor_mem + hv_core_and_percpu_size;
+			 page = PTR_ALIGN(page + 1, PGDIR_SIZE))
+			readl((void __iomem *)page);
+
+	/* JAILHOUSE_HC_DISABLE either returns 0 or the same error code across
+	 * all CPUs */
+	err = jailhouse_call(num);
 
 #if defined(CONFIG_X86) && LINUX_VERSION_CODE >= KERNEL_VERSION(4, 0, 0)
 	/* on Intel, VMXE is now off - update the shadow */
-	if (boot_cpu_has(X86_FEATURE_VMX) && !err)
+	if (boot_cpu_has(X86_FEATURE_VMX) && !err && !jailhouse_standin_call)
 	{
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 5, 0)
 		cr4_clear_bits_irqsoff(X86_CR4_VMXE);
@@ -670,13 +1503,19 @@ static void leave_hypervisor(void *info)
 	}
 #endif
 
-	atomic_inc(&call_done);
+	trace_jailhouse_cpu_end(cpu, JAILHOUSE_PHASE_LEAVE, err);
+
+	return err;
+}
+
+static int leave_hypervisor(void *info)
+{
+	return leave_hypervisor_call(JAILHOUSE_HC_DISABLE);
 }
 
 static int jailhouse_cmd_disable(void)
 {
 	int err;
-	unsigned int cpu;
 
 	if (mutex_lock_interruptible(&jailhouse_lock) != 0)
 		return -EINTR;
@@ -687,60 +1526,381 @@ static int jailhouse_cmd_disable(void)
 		goto unlock_out;
 	}
 
-	error_code = 0;
+	jailhouse_phase_begin(JAILHOUSE_PHASE_DISABLE);
+
+	/* no batched or benchmark hypercalls may be in flight while leaving */
+	down_write(&bench_sem);
+	jailhouse_hc_ring_stop();
 
+	cpus_read_lock();
 	preempt_disable();
 
-	if (num_online_cpus() != enter_hv_cpus)
+	if (!cpumask_equal(&vm_cpus_mask, cpu_online_mask))
 	{
 		/*
-		 * Not all assigned CPUs are currently online. If we disable
-		 * now, we will lose the offlined ones.
+		 * Not all assigned CPUs are currently online, or CPUs came
+		 * online without entering. If we disable now, we will lose the
+		 * offlined ones. Only happens if !cpuhp_follow.
 		 */
 
 		preempt_enable();
+		cpus_read_unlock();
 
+		start_hc_rings();
 		err = -EBUSY;
-		goto unlock_out;
+		goto sem_out;
 	}
 
-	atomic_set(&call_done, 0);
-	/* See jailhouse_cmd_enable while wait=true does not work. */
-	on_each_cpu_mask(&vm_cpus_mask, leave_hypervisor, NULL, 0);
-	while (atomic_read(&call_done) != num_online_cpus())
-		cpu_relax();
+	jailhouse_phase_begin(JAILHOUSE_PHASE_LEAVE);
+	err = jailhouse_rendezvous(&vm_cpus_mask, leave_hypervisor, NULL);
+	jailhouse_phase_end(JAILHOUSE_PHASE_LEAVE, err);
+
+	preempt_enable();
+	if (!err || err == -ETIMEDOUT)
+		cpuhp_follow = false;
+	cpus_read_unlock();
 
-	for (cpu = 0; cpu < max_cpus; cpu++)
+	if (err == -ETIMEDOUT)
 	{
-		if (cpu >= max_cpus - rt_cpus)
-		{
-			cpu_up(cpu);
-		}
+		/* See jailhouse_enable_attempt(), nothing can be torn down. */
+		pr_crit(
+			"jailhouse: CPUs stuck leaving the hypervisor, reboot to "
+			"recover\n");
+		goto sem_out;
 	}
-	pr_info(
-		"Disable hypervisor OK: max_cpus=%d, rt_cpus=%d, num_online_cpus=%d\n",
-		max_cpus, rt_cpus, num_online_cpus());
 
-	preempt_enable();
-
-	err = error_code;
 	if (err)
 	{
+		/* still enabled, the RT CPUs keep running the RTOS */
 		pr_warn("jailhouse: Failed to disable hypervisor: %d\n", err);
-		goto unlock_out;
+		start_hc_rings();
+		goto sem_out;
 	}
 
+	online_rt_cpus();
+	pr_info(
+		"Disable hypervisor OK: max_cpus=%d, rt_cpus=%d, num_online_cpus=%d\n",
+		max_cpus, rt_cpus, num_online_cpus());
+
 	jailhouse_enabled = false;
+	jailhouse_standin_call = NULL;
+	jailhouse_sysfs_stats_stop();
+	jailhouse_console_stop();
+	/* the next enable may reuse the memory behind it for anything */
+	jailhouse_console_revoke();
+	jailhouse_numa_percpu_free();
+	jailhouse_balloon_release();
+	jailhouse_cma_free_regions();
 	module_put(THIS_MODULE);
 
 	pr_info("The Jailhouse was closed.\n");
 
+sem_out:
+	up_write(&bench_sem);
+	jailhouse_phase_end(JAILHOUSE_PHASE_DISABLE, err);
+
 unlock_out:
 	mutex_unlock(&jailhouse_lock);
 
 	return err;
 }
 
+/*
+ * CPU hotplug callbacks, run on the CPU coming or going. They cannot take
+ * jailhouse_lock, enable and CPU assignment hotplug CPUs while holding it.
+ * The hotplug lock orders them against the rendezvous instead.
+ */
+static int jailhouse_cpu_online(unsigned int cpu)
+{
+	unsigned long flags;
+	int err;
+
+	/*
+	 * RT and parked CPUs belong to the hypervisor, not to Linux, until
+	 * disabled. CPU assignment clears the bit before onlining one.
+	 */
+	if (READ_ONCE(rt_cpus_taken) &&
+		(cpumask_test_cpu(cpu, &rt_cpus_mask) ||
+		 cpumask_test_cpu(cpu, &parked_cpus_mask)))
+		return -EBUSY;
+	if (!cpuhp_follow)
+		return 0;
+
+	local_irq_save(flags);
+	err = enter_hypervisor(hypervisor_mem);
+	local_irq_restore(flags);
+	if (err)
+	{
+		pr_err(
+			"jailhouse: CPU %u failed to enter the hypervisor: %d\n", cpu,
+			err);
+		return err;
+	}
+	cpumask_set_cpu(cpu, &vm_cpus_mask);
+	return 0;
+}
+
+static int jailhouse_cpu_offline(unsigned int cpu)
+{
+	unsigned long flags;
+	int err;
+
+	if (!cpuhp_follow || !cpumask_test_cpu(cpu, &vm_cpus_mask))
+		return 0;
+
+	local_irq_save(flags);
+	err = leave_hypervisor_call(JAILHOUSE_HC_CPU_RELEASE);
+	local_irq_restore(flags);
+	if (err)
+	{
+		pr_err(
+			"jailhouse: CPU %u failed to leave the hypervisor: %d\n", cpu,
+			err);
+		return err;
+	}
+	cpumask_clear_cpu(cpu, &vm_cpus_mask);
+	return 0;
+}
+
+/*
+ * Record @c cpu as RT CPU, or as Linux CPU if @c rt is false, in the
+ * driver's mask and in the RT CPU set of the hypervisor memory.
+ */
+static void set_rt_cpu(unsigned int cpu, bool rt)
+{
+	unsigned long *rt_cpu_set = hypervisor_mem + rt_cpu_set_offset;
+
+	if (rt)
+	{
+		cpumask_set_cpu(cpu, &rt_cpus_mask);
+		if (rt_cpu_set_offset)
+			set_bit(cpu, rt_cpu_set);
+		rt_cpus++;
+	}
+	else
+	{
+		cpumask_clear_cpu(cpu, &rt_cpus_mask);
+		if (rt_cpu_set_offset)
+			clear_bit(cpu, rt_cpu_set);
+		rt_cpus--;
+	}
+}
+
+/* Offline a Linux CPU and start the RTOS on it. */
+static int assign_cpu_to_rt(unsigned int cpu)
+{
+	int err;
+
+	if (cpu == 0 || cpu >= max_cpus || !cpumask_test_cpu(cpu, &vm_cpus_mask))
+		return -EINVAL;
+
+	err = cpu_down(cpu);
+	if (err)
+		return err;
+
+	err = jailhouse_call_arg2(JAILHOUSE_HC_CPU_ASSIGN, cpu, JAILHOUSE_CPU_RT);
+	if (err)
+	{
+		pr_err(
+			"jailhouse: CPU %u could not be assigned to the RT partition: "
+			"%d\n",
+			cpu, err);
+		cpu_up(cpu);
+		return err;
+	}
+
+	set_rt_cpu(cpu, true);
+	return 0;
+}
+
+/* Stop the RTOS on an RT CPU and online it for Linux. */
+static int assign_cpu_to_linux(unsigned int cpu)
+{
+	int err;
+
+	if (!cpumask_test_cpu(cpu, &rt_cpus_mask))
+		return -EINVAL;
+	/* the RT partition keeps at least one CPU */
+	if (rt_cpus == 1)
+		return -EBUSY;
+
+	err = jailhouse_call_arg2(
+		JAILHOUSE_HC_CPU_ASSIGN, cpu, JAILHOUSE_CPU_LINUX);
+	if (err)
+		return err;
+	set_rt_cpu(cpu, false);
+
+	err = cpu_up(cpu);
+	if (err)
+	{
+		pr_err("jailhouse: CPU %u could not be onlined: %d\n", cpu, err);
+		if (jailhouse_call_arg2(
+				JAILHOUSE_HC_CPU_ASSIGN, cpu, JAILHOUSE_CPU_RT) == 0)
+			set_rt_cpu(cpu, true);
+		else
+			pr_err("jailhouse: CPU %u is now unused\n", cpu);
+	}
+	return err;
+}
+
+static int jailhouse_cmd_cpu_assign(struct jailhouse_cpu_assign __user *arg)
+{
+	struct jailhouse_cpu_assign assign;
+	int err;
+
+	if (copy_from_user(&assign, arg, sizeof(assign)))
+		return -EFAULT;
+	if (assign.cpu >= nr_cpu_ids ||
+		(assign.target != JAILHOUSE_CPU_LINUX &&
+		 assign.target != JAILHOUSE_CPU_RT))
+		return -EINVAL;
+
+	if (mutex_lock_interruptible(&jailhouse_lock) != 0)
+		return -EINTR;
+
+	if (!jailhouse_enabled)
+		err = -EINVAL;
+	/* without an RT CPU set the RT CPUs must stay the last ones */
+	else if (!cpuhp_follow || !jailhouse_image_has_rt_cpu_set())
+		err = -EOPNOTSUPP;
+	else if (assign.target == JAILHOUSE_CPU_RT)
+		err = assign_cpu_to_rt(assign.cpu);
+	else
+		err = assign_cpu_to_linux(assign.cpu);
+	if (!err)
+		pr_info(
+			"jailhouse: CPU %u assigned to %s, RT CPUs %*pbl\n", assign.cpu,
+			assign.target == JAILHOUSE_CPU_RT ? "the RT partition" : "Linux",
+			cpumask_pr_args(&rt_cpus_mask));
+
+	mutex_unlock(&jailhouse_lock);
+	return err;
+}
+
+static int
+jailhouse_cmd_bench_hypercall(struct jailhouse_bench_hypercall __user *arg)
+{
+	struct jailhouse_bench_hypercall bench;
+	struct jailhouse_bench_cpu *results;
+	int err;
+
+	if (copy_from_user(&bench, arg, sizeof(bench)))
+		return -EFAULT;
+	if (!bench.num_cpus)
+		return -EINVAL;
+	bench.num_cpus = min(bench.num_cpus, nr_cpu_ids);
+
+	results = kvmalloc_array(bench.num_cpus, sizeof(*results), GFP_KERNEL);
+	if (!results)
+		return -ENOMEM;
+
+	if (mutex_lock_interruptible(&jailhouse_lock) != 0)
+	{
+		err = -EINTR;
+		goto out;
+	}
+	if (!jailhouse_enabled)
+	{
+		mutex_unlock(&jailhouse_lock);
+		err = -EINVAL;
+		goto out;
+	}
+	/*
+	 * Keeps the hypervisor enabled for the whole run, which can take
+	 * seconds per CPU, without blocking other commands meanwhile.
+	 */
+	down_read(&bench_sem);
+	mutex_unlock(&jailhouse_lock);
+
+	err = jailhouse_bench_hypercall(
+		&vm_cpus_mask, bench.iterations, results, bench.num_cpus);
+	up_read(&bench_sem);
+	if (err)
+		goto out;
+
+#ifdef CONFIG_X86
+	bench.tsc_khz = tsc_khz;
+#else
+	bench.tsc_khz = 0;
+#endif
+	if (copy_to_user(
+			u64_to_user_ptr(bench.cpus), results,
+			bench.num_cpus * sizeof(*results)) ||
+		copy_to_user(arg, &bench, sizeof(bench)))
+		err = -EFAULT;
+
+out:
+	kvfree(results);
+	return err;
+}
+
+static int jailhouse_cmd_load_rt(struct jailhouse_load_rt __user *arg)
+{
+	struct jailhouse_load_rt load;
+	int err;
+
+	if (copy_from_user(&load, arg, sizeof(load)))
+		return -EFAULT;
+
+	/* the load pins rt_region itself, ioctls need not wait for it */
+	err = jailhouse_rt_load(&load);
+
+	if (!err && copy_to_user(arg, &load, sizeof(load)))
+		err = -EFAULT;
+	return err;
+}
+
+static int jailhouse_cmd_balloon(struct jailhouse_balloon __user *arg)
+{
+	struct jailhouse_balloon balloon;
+	int err;
+
+	if (copy_from_user(&balloon, arg, sizeof(balloon)))
+		return -EFAULT;
+
+	if (mutex_lock_interruptible(&jailhouse_lock) != 0)
+		return -EINTR;
+	if (!jailhouse_enabled)
+		err = -EINVAL;
+	else if (!jailhouse_image_has_mem_balloon())
+		err = -EOPNOTSUPP;
+	else
+		err = jailhouse_balloon(&balloon);
+	/* the memory layout no longer matches the cached configuration */
+	if (!err)
+		loaded_config_hash = 0;
+	mutex_unlock(&jailhouse_lock);
+
+	if (!err && copy_to_user(arg, &balloon, sizeof(balloon)))
+		err = -EFAULT;
+	return err;
+}
+
+static int
+jailhouse_cmd_enable_status(struct jailhouse_enable_status __user *arg)
+{
+	struct jailhouse_enable_status status;
+
+	spin_lock(&enable_status_lock);
+	status = enable_status;
+	spin_unlock(&enable_status_lock);
+
+	return copy_to_user(arg, &status, sizeof(status)) ? -EFAULT : 0;
+}
+
+/* Readable unless an enable is running, i.e. once an enable is done. */
+static __poll_t jailhouse_poll(struct file *file, poll_table *wait)
+{
+	__poll_t mask = 0;
+
+	poll_wait(file, &enable_wait, wait);
+	spin_lock(&enable_status_lock);
+	if (enable_status.state != JAILHOUSE_ENABLE_RUNNING)
+		mask = EPOLLIN | EPOLLRDNORM;
+	spin_unlock(&enable_status_lock);
+	return mask;
+}
+
 static long
 jailhouse_ioctl(struct file *file, unsigned int ioctl, unsigned long arg)
 {
@@ -754,6 +1914,24 @@ jailhouse_ioctl(struct file *file, unsigned int ioctl, unsigned long arg)
 	case JAILHOUSE_DISABLE:
 		err = jailhouse_cmd_disable();
 		break;
+	case JAILHOUSE_BENCH_HYPERCALL:
+		err = jailhouse_cmd_bench_hypercall(
+			(struct jailhouse_bench_hypercall __user *)arg);
+		break;
+	case JAILHOUSE_LOAD_RT:
+		err = jailhouse_cmd_load_rt((struct jailhouse_load_rt __user *)arg);
+		break;
+	case JAILHOUSE_ENABLE_STATUS:
+		err = jailhouse_cmd_enable_status(
+			(struct jailhouse_enable_status __user *)arg);
+		break;
+	case JAILHOUSE_CPU_ASSIGN:
+		err = jailhouse_cmd_cpu_assign(
+			(struct jailhouse_cpu_assign __user *)arg);
+		break;
+	case JAILHOUSE_BALLOON:
+		err = jailhouse_cmd_balloon((struct jailhouse_balloon __user *)arg);
+		break;
 	default:
 		err = -EINVAL;
 		break;
@@ -766,6 +1944,9 @@ static const struct file_operations jailhouse_fops = {
 	.owner = THIS_MODULE,
 	.unlocked_ioctl = jailhouse_ioctl,
 	.compat_ioctl = jailhouse_ioctl,
+	.poll = jailhouse_poll,
+	.mmap = jailhouse_rt_mmap,
+	.get_unmapped_area = jailhouse_rt_get_unmapped_area,
 	.llseek = noop_llseek,
 };
 
@@ -780,6 +1961,8 @@ static int jailhouse_shutdown_notify(
 {
 	int err;
 
+	/* a queued enable would otherwise enter after the disable */
+	flush_work(&enable_work);
 	err = jailhouse_cmd_disable();
 	if (err && err != -EINVAL)
 		pr_emerg("jailhouse: ordered shutdown failed!\n");
@@ -795,6 +1978,8 @@ static int __init jailhouse_init(void)
 {
 	int err;
 
+	BUILD_BUG_ON(JAILHOUSE_NUM_PHASES > JAILHOUSE_STATUS_MAX_PHASES);
+
 #if defined(CONFIG_KALLSYMS_ALL) // && LINUX_VERSION_CODE <
 								 // KERNEL_VERSION(5,7,0)
 #define __RESOLVE_EXTERNAL_SYMBOL(symbol)                                      \
@@ -806,7 +1991,7 @@ static int __init jailhouse_init(void)
 	}                                                                          \
 	else                                                                       \
 	{                                                                          \
-		pr_err(                                                                \
+		pr_debug(                                                              \
 			"Resolved symbol %s: 0x%lx\n", #symbol,                            \
 			(unsigned long)symbol##_sym);                                      \
 	}
@@ -827,21 +2012,60 @@ static int __init jailhouse_init(void)
 	RESOLVE_EXTERNAL_SYMBOL(__pmd_alloc);
 
 	init_mm_sym = (struct mm_struct *)generic_kallsyms_lookup_name("init_mm");
+	/* optional, leave_hypervisor() falls back to touching the mapping */
+	arch_sync_kernel_mappings_sym =
+		(void *)generic_kallsyms_lookup_name("arch_sync_kernel_mappings");
+	/* optional, see image_stat_name() */
+	fw_path_para_sym = (char *)generic_kallsyms_lookup_name("fw_path_para");
+#ifdef CONFIG_CMA
+	/* optional, needed for regions from CMA only */
+	cma_for_each_area_sym =
+		(void *)generic_kallsyms_lookup_name("cma_for_each_area");
+#endif
+
+	jailhouse_hotplug_init();
 
 	jailhouse_dev = root_device_register("jailhouse");
 	if (IS_ERR(jailhouse_dev))
 		return PTR_ERR(jailhouse_dev);
 
-	err = misc_register(&jailhouse_misc_dev);
+	err = jailhouse_sysfs_init(jailhouse_dev);
 	if (err)
 		goto unreg_dev;
 
+	err = jailhouse_rendezvous_init();
+	if (err)
+		goto remove_sysfs;
+
+	err = cpuhp_setup_state_nocalls(
+		CPUHP_AP_ONLINE_DYN, "jailhouse:online", jailhouse_cpu_online,
+		jailhouse_cpu_offline);
+	if (err < 0)
+		goto exit_rendezvous;
+	jailhouse_cpuhp_state = err;
+
+	err = misc_register(&jailhouse_misc_dev);
+	if (err)
+		goto remove_cpuhp;
+
+	err = jailhouse_console_init();
+	if (err)
+		goto deregister_misc;
+
 	register_reboot_notifier(&jailhouse_shutdown_nb);
 
 	init_hypercall();
 
 	return 0;
 
+deregister_misc:
+	misc_deregister(&jailhouse_misc_dev);
+remove_cpuhp:
+	cpuhp_remove_state_nocalls(jailhouse_cpuhp_state);
+exit_rendezvous:
+	jailhouse_rendezvous_exit();
+remove_sysfs:
+	jailhouse_sysfs_exit(jailhouse_dev);
 unreg_dev:
 	root_device_unregister(jailhouse_dev);
 	return err;
@@ -850,8 +2074,19 @@ unreg_dev:
 static void __exit jailhouse_exit(void)
 {
 	unregister_reboot_notifier(&jailhouse_shutdown_nb);
+	jailhouse_console_exit();
 	misc_deregister(&jailhouse_misc_dev);
+	/* a queued enable fails, the module is going */
+	flush_work(&enable_work);
+	cpuhp_remove_state_nocalls(jailhouse_cpuhp_state);
 	jailhouse_firmware_free();
+	jailhouse_image_free(&hv_image);
+	jailhouse_hotplug_remove();
+	jailhouse_cma_free_regions();
+	jailhouse_rt_mmap_revoke(NULL);
+	jailhouse_console_revoke();
+	jailhouse_rendezvous_exit();
+	jailhouse_sysfs_exit(jailhouse_dev);
 	root_device_unregister(jailhouse_dev);
 }
 
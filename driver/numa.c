@@ -0,0 +1,190 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * CPU and NUMA topology for the system configuration, and node-local memory
+ * for the per-CPU areas of the hypervisor. hv_region usually sits on a
+ * single node, so without the latter every CPU of the other nodes reaches
+ * its per-CPU data and stack remotely on each VM exit.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#include <linux/gfp.h>
+#include <linux/io.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/mmzone.h>
+#include <linux/nodemask.h>
+#include <linux/slab.h>
+#include <linux/topology.h>
+
+#include "numa.h"
+
+/* Node-local per-CPU memory handed to the hypervisor, indexed by node */
+static void **percpu_chunks;
+static unsigned long *percpu_chunk_sizes;
+
+static unsigned int numa_cpu_node(unsigned int cpu)
+{
+	int node = cpu_to_node(cpu);
+
+	/* every CPU has to be on some node for the per-CPU placement */
+	return node == NUMA_NO_NODE ? first_online_node : node;
+}
+
+/**
+ * Describe CPUs 0 to num_cpus - 1 and all nodes. The node table has no
+ * per-CPU memory yet.
+ *
+ * @return 0 on success, -ENOMEM otherwise.
+ */
+int jailhouse_numa_topology_init(
+	struct jailhouse_topology *topology, unsigned int num_cpus)
+{
+	struct jailhouse_numa_node *nodes;
+	unsigned int cpu;
+	__u32 *cpu_node;
+	int node;
+
+	nodes = kcalloc(nr_node_ids, sizeof(*nodes), GFP_KERNEL);
+	cpu_node = kcalloc(num_cpus, sizeof(*cpu_node), GFP_KERNEL);
+	if (!nodes || !cpu_node)
+	{
+		kfree(nodes);
+		kfree(cpu_node);
+		return -ENOMEM;
+	}
+
+	for_each_node_state(node, N_MEMORY)
+	{
+		nodes[node].mem_start = PFN_PHYS(node_start_pfn(node));
+		nodes[node].mem_size = PFN_PHYS(node_spanned_pages(node));
+	}
+	for (cpu = 0; cpu < num_cpus; cpu++)
+		cpu_node[cpu] = numa_cpu_node(cpu);
+
+	topology->num_nodes = nr_node_ids;
+	topology->num_cpus = num_cpus;
+	topology->nodes = nodes;
+	topology->cpu_node = cpu_node;
+	return 0;
+}
+
+void jailhouse_numa_topology_free(struct jailhouse_topology *topology)
+{
+	kfree(topology->nodes);
+	kfree(topology->cpu_node);
+	topology->nodes = NULL;
+	topology->cpu_node = NULL;
+}
+
+/**
+ * Allocate zeroed per-CPU memory on each node with CPUs and enter it into
+ * the node table. Only done for multiple nodes and as a whole: if a chunk
+ * cannot be allocated, all per-CPU areas stay behind the hypervisor core.
+ *
+ * @return 0 if the per-CPU areas are node-local, -ENOENT for a single
+ * node, -ENOMEM otherwise.
+ */
+int jailhouse_numa_percpu_alloc(
+	struct jailhouse_topology *topology, unsigned long percpu_size)
+{
+	struct jailhouse_numa_node *nodes =
+		(struct jailhouse_numa_node *)topology->nodes;
+	unsigned int cpu, node, *cpus;
+	unsigned long size;
+	int err = 0;
+
+	if (num_online_nodes() < 2)
+		return -ENOENT;
+
+	cpus = kcalloc(nr_node_ids, sizeof(*cpus), GFP_KERNEL);
+	percpu_chunks = kcalloc(nr_node_ids, sizeof(*percpu_chunks), GFP_KERNEL);
+	percpu_chunk_sizes =
+		kcalloc(nr_node_ids, sizeof(*percpu_chunk_sizes), GFP_KERNEL);
+	if (!cpus || !percpu_chunks || !percpu_chunk_sizes)
+	{
+		err = -ENOMEM;
+		goto out;
+	}
+
+	for (cpu = 0; cpu < topology->num_cpus; cpu++)
+		cpus[topology->cpu_node[cpu]]++;
+
+	for (node = 0; node < nr_node_ids; node++)
+	{
+		if (!cpus[node])
+			continue;
+		/* falls back to the nearest node if this one has no memory */
+		size = PAGE_ALIGN(cpus[node] * percpu_size);
+		percpu_chunks[node] = alloc_pages_exact_nid(
+			node, size, GFP_KERNEL | __GFP_ZERO | __GFP_NOWARN);
+		if (!percpu_chunks[node])
+		{
+			pr_info(
+				"jailhouse: no 0x%lx bytes of per-CPU memory on node %u, "
+				"using the hypervisor memory\n",
+				size, node);
+			err = -ENOMEM;
+			goto out;
+		}
+		percpu_chunk_sizes[node] = size;
+		nodes[node].percpu_start = virt_to_phys(percpu_chunks[node]);
+		nodes[node].percpu_size = size;
+	}
+
+out:
+	kfree(cpus);
+	if (err)
+	{
+		jailhouse_numa_percpu_free();
+		for (node = 0; node < topology->num_nodes; node++)
+			nodes[node].percpu_start = nodes[node].percpu_size = 0;
+	}
+	return err;
+}
+
+/**
+ * Name the per-CPU memory JAILHOUSE_IOMEM_HYPERVISOR in the iomem entries,
+ * so that the root cell gets no access to the hypervisor's stacks and
+ * per-CPU data.
+ * @param iomem		Top-level entries, with room for two more per node.
+ * @param num		Number of entries.
+ *
+ * @return New number of entries.
+ */
+int jailhouse_numa_percpu_carve(struct jailhouse_iomem_entry *iomem, int num)
+{
+	struct mem_region region;
+	unsigned int node;
+
+	if (!percpu_chunks)
+		return num;
+	for (node = 0; node < nr_node_ids; node++)
+	{
+		if (!percpu_chunks[node])
+			continue;
+		region.start = virt_to_phys(percpu_chunks[node]);
+		region.size = percpu_chunk_sizes[node];
+		num = jailhouse_iomem_carve(
+			iomem, num, &region, JAILHOUSE_IOMEM_HYPERVISOR);
+	}
+	return num;
+}
+
+/* Release the per-CPU memory once the hypervisor no longer uses it. */
+void jailhouse_numa_percpu_free(void)
+{
+	unsigned int node;
+
+	if (percpu_chunks)
+		for (node = 0; node < nr_node_ids; node++)
+			if (percpu_chunks[node])
+				free_pages_exact(
+					percpu_chunks[node], percpu_chunk_sizes[node]);
+	kfree(percpu_chunks);
+	kfree(percpu_chunk_sizes);
+	percpu_chunks = NULL;
+	percpu_chunk_sizes = NULL;
+}
@@ -0,0 +1,15 @@
+#ifndef _JAILHOUSE_NUMA_H
+#define _JAILHOUSE_NUMA_H
+
+#include "regions.h"
+
+int jailhouse_numa_topology_init(
+	struct jailhouse_topology *topology, unsigned int num_cpus);
+void jailhouse_numa_topology_free(struct jailhouse_topology *topology);
+
+int jailhouse_numa_percpu_alloc(
+	struct jailhouse_topology *topology, unsigned long percpu_size);
+int jailhouse_numa_percpu_carve(struct jailhouse_iomem_entry *iomem, int num);
+void jailhouse_numa_percpu_free(void);
+
+#endif /* !_JAILHOUSE_NUMA_H */
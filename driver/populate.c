@@ -0,0 +1,157 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Parallel population of the hypervisor memory region.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/nodemask.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/workqueue.h>
+
+#include "populate.h"
+
+/* Below this size per worker, queueing work costs more than it saves. */
+#define POPULATE_MIN_CHUNK (2UL << 20)
+
+static unsigned int populate_workers;
+module_param(populate_workers, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(
+	populate_workers,
+	"Number of workers populating the hypervisor memory "
+	"(0: one per online CPU)");
+
+struct populate_work
+{
+	struct work_struct work;
+	const struct jailhouse_populate_range *ranges;
+	unsigned int num;
+	/* byte interval of the concatenated ranges handled by this worker */
+	unsigned long begin, end;
+};
+
+static void populate_copy(void *dst, const void *src, unsigned long size)
+{
+	/* Streaming stores where the arch has them (falls back to memcpy),
+	 * so that the image does not evict the worker's cache. */
+	memcpy_flushcache(dst, src, size);
+}
+
+static void populate_clear(void *dst, unsigned long size)
+{
+#ifdef __HAVE_ARCH_MEMCPY_FLUSHCACHE
+	const void *zero = page_address(ZERO_PAGE(0));
+	unsigned long n;
+
+	while (size)
+	{
+		n = min(size, PAGE_SIZE);
+		memcpy_flushcache(dst, zero, n);
+		dst += n;
+		size -= n;
+	}
+#else
+	memset(dst, 0, size);
+#endif
+}
+
+static void populate_interval(
+	const struct jailhouse_populate_range *ranges, unsigned int num,
+	unsigned long begin, unsigned long end)
+{
+	unsigned long base = 0, from, to;
+	unsigned int n;
+
+	for (n = 0; n < num && base < end; base += ranges[n].size, n++)
+	{
+		from = max(begin, base);
+		to = min(end, base + ranges[n].size);
+		if (from >= to)
+			continue;
+
+		if (ranges[n].src)
+			populate_copy(
+				ranges[n].dst + (from - base), ranges[n].src + (from - base),
+				to - from);
+		else
+			populate_clear(ranges[n].dst + (from - base), to - from);
+	}
+
+	/* order the streaming stores before reporting completion */
+	wmb();
+}
+
+static void populate_work_fn(struct work_struct *work)
+{
+	struct populate_work *pw = container_of(work, struct populate_work, work);
+
+	populate_interval(pw->ranges, pw->num, pw->begin, pw->end);
+}
+
+/**
+ * Copy or clear the given ranges, split across workers on all online nodes.
+ * @param ranges	Ranges to populate.
+ * @param num		Number of ranges.
+ */
+void jailhouse_populate(
+	const struct jailhouse_populate_range *ranges, unsigned int num)
+{
+	unsigned long total = 0, chunk, begin;
+	unsigned int n, workers, node;
+	struct populate_work *pw;
+	ktime_t start;
+	s64 ns;
+
+	for (n = 0; n < num; n++)
+		total += ranges[n].size;
+
+	workers = populate_workers ?: num_online_cpus();
+	workers = min_t(
+		unsigned long, workers, DIV_ROUND_UP(total, POPULATE_MIN_CHUNK));
+
+	start = ktime_get();
+
+	pw = workers > 1 ? kcalloc(workers, sizeof(*pw), GFP_KERNEL) : NULL;
+	if (!pw)
+	{
+		workers = 1;
+		populate_interval(ranges, num, 0, total);
+		goto out;
+	}
+
+	/* page-aligned chunks, the last worker takes the remainder */
+	chunk = PAGE_ALIGN(DIV_ROUND_UP(total, workers));
+	node = first_node(node_online_map);
+	for (n = 0, begin = 0; n < workers && begin < total; n++, begin += chunk)
+	{
+		pw[n].ranges = ranges;
+		pw[n].num = num;
+		pw[n].begin = begin;
+		pw[n].end = min(begin + chunk, total);
+		INIT_WORK(&pw[n].work, populate_work_fn);
+
+		/* spread the workers round-robin over the nodes */
+		queue_work_node(node, system_unbound_wq, &pw[n].work);
+		node = next_node_in(node, node_online_map);
+	}
+	workers = n;
+
+	for (n = 0; n < workers; n++)
+		flush_work(&pw[n].work);
+	kfree(pw);
+
+out:
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	pr_info(
+		"jailhouse: populated %lu KiB in %lld us with %u worker(s), "
+		"%llu MB/s\n",
+		total >> 10, ns / NSEC_PER_USEC, workers,
+		ns ? div64_u64((u64)total * 1000, ns) : 0);
+}
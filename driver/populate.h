@@ -0,0 +1,19 @@
+#ifndef _JAILHOUSE_POPULATE_H
+#define _JAILHOUSE_POPULATE_H
+
+/**
+ * A range of the hypervisor memory to be filled by jailhouse_populate().
+ * If @c src is NULL, the range is cleared, otherwise @c size bytes are
+ * copied from @c src.
+ */
+struct jailhouse_populate_range
+{
+	void *dst;
+	const void *src;
+	unsigned long size;
+};
+
+void jailhouse_populate(
+	const struct jailhouse_populate_range *ranges, unsigned int num);
+
+#endif /* !_JAILHOUSE_POPULATE_H */
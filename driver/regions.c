@@ -0,0 +1,443 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Generation of the root cell memory regions and the system configuration
+ * from the iomem resource tree. Free of kernel dependencies so that it can
+ * also be built into tools/jailhouse-regions for testing and benchmarking.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#ifdef JAILHOUSE_USERSPACE
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#define PAGE_SIZE 4096ULL
+#define SZ_2M 0x00200000ULL
+#define SZ_1G 0x40000000ULL
+
+#define round_up(x, y) ((((x) - 1) | ((__typeof__(x))((y) - 1))) + 1)
+#define round_down(x, y) ((x) & ~((__typeof__(x))((y) - 1)))
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+
+#define pr_err(fmt, ...) fprintf(stderr, fmt, ##__VA_ARGS__)
+#define pr_debug(fmt, ...)                                                     \
+	do                                                                         \
+	{                                                                          \
+	} while (0)
+#else /* !JAILHOUSE_USERSPACE */
+#include <linux/kernel.h>
+#include <linux/sizes.h>
+#include <linux/string.h>
+#endif /* !JAILHOUSE_USERSPACE */
+
+#include "regions.h"
+
+static unsigned long long mem_region_flag(const char *name)
+{
+	if (!strcmp(name, "System RAM") || !strcmp(name, "RAM buffer"))
+		return JAILHOUSE_MEM_READ | JAILHOUSE_MEM_WRITE |
+			   JAILHOUSE_MEM_EXECUTE | JAILHOUSE_MEM_DMA;
+	else if (!strcmp(name, "Reserved"))
+		return JAILHOUSE_MEM_READ | JAILHOUSE_MEM_WRITE | JAILHOUSE_MEM_EXECUTE;
+	else
+		return JAILHOUSE_MEM_READ | JAILHOUSE_MEM_WRITE;
+}
+
+static bool get_mem_region_one(
+	struct mem_region *region, const char *name,
+	const struct mem_region *reserved, struct jailhouse_memory *regions,
+	int *num)
+{
+	unsigned long long flags = 0, l_start = 0, l_end = 0;
+	unsigned long long s = region->start;
+	unsigned long long e = s + region->size;
+	unsigned long long res_start = reserved->start;
+	unsigned long long res_end = res_start + reserved->size;
+	bool ok = true;
+	int l_index = 0;
+
+	if (s == e)
+	{
+		return true;
+	}
+
+	if (s <= res_start && res_end <= e)
+	{
+		if (strcmp(name, "Reserved"))
+		{
+			return false;
+		}
+		if (s < res_start)
+		{
+			region->start = s;
+			region->size = res_start - s;
+			ok = get_mem_region_one(region, name, reserved, regions, num);
+		}
+		if (ok && res_end < e)
+		{
+			region->start = res_end;
+			region->size = e - res_end;
+			ok = get_mem_region_one(region, name, reserved, regions, num);
+		}
+		return ok;
+	}
+	else if (!(e <= res_start || res_end <= s))
+	{
+		pr_err("overlapped with reserved region");
+		return false;
+	}
+
+	s = round_down(s, PAGE_SIZE);
+	e = round_up(e, PAGE_SIZE) - 1;
+	if ((*num) == 0)
+	{
+		l_start = 0;
+		l_end = 0;
+	}
+	else
+	{
+		l_index = (*num) - 1;
+		l_start = regions[l_index].phys_start;
+		l_end = regions[l_index].phys_start + regions[l_index].size - 1;
+	}
+	flags = mem_region_flag(name);
+	// check if current region is overlapped with last one, which happens
+	// when both share a page
+	if (s < l_end)
+	{
+		pr_debug(
+			"overlap last:(0x%llx 0x%llx) now:(0x%llx 0x%llx)\n", l_start,
+			l_end, s, e);
+		if (flags == regions[l_index].flags)
+		{
+			s = min(s, l_start);
+			e = max(e, l_end);
+			(*num)--;
+		}
+		// otherwise the shared pages get the region with fewer rights,
+		// e.g. no DMA to a reserved range next to RAM
+		else if (!(flags & ~regions[l_index].flags))
+		{
+			if (s <= l_start)
+				(*num)--;
+			else
+				regions[l_index].size = s - l_start;
+		}
+		else
+		{
+			if (e <= l_end)
+				return true;
+			s = l_end + 1;
+		}
+	}
+
+	regions[*num].phys_start = s;
+	regions[*num].virt_start = s;
+	regions[*num].size = e - s + 1;
+	regions[*num].flags = flags;
+	pr_debug(
+		"add region %d: %s [0x%llx..0x%llx] 0x%llx\n", *num, name,
+		regions[*num].phys_start,
+		regions[*num].phys_start + regions[*num].size - 1, regions[*num].flags);
+	(*num)++;
+
+	return true;
+}
+
+/**
+ * Give part of a top-level entry another name by splitting the entry.
+ * @param iomem		Top-level entries, with room for two more.
+ * @param num		Number of entries.
+ * @param region	Part of one entry to rename.
+ * @param name		New name of the part.
+ *
+ * @return New number of entries, unchanged if no entry contains @c region.
+ */
+int jailhouse_iomem_carve(
+	struct jailhouse_iomem_entry *iomem, int num,
+	const struct mem_region *region, const char *name)
+{
+	unsigned long long end = region->start + region->size - 1;
+	struct jailhouse_iomem_entry entry;
+	int n, parts;
+
+	for (n = 0; n < num; n++)
+		if (iomem[n].start <= region->start && end <= iomem[n].end)
+			break;
+	if (n == num)
+		return num;
+
+	entry = iomem[n];
+	parts = (entry.start < region->start) + 1 + (end < entry.end);
+	memmove(&iomem[n + parts], &iomem[n + 1], (num - n - 1) * sizeof(*iomem));
+	if (entry.start < region->start)
+	{
+		iomem[n].end = region->start - 1;
+		n++;
+	}
+	iomem[n].start = region->start;
+	iomem[n].end = end;
+	iomem[n].name = name;
+	if (end < entry.end)
+	{
+		iomem[n + 1].start = end + 1;
+		iomem[n + 1].end = entry.end;
+		iomem[n + 1].name = entry.name;
+	}
+	return num + parts - 1;
+}
+
+/**
+ * Get the memory regions reported to the hypervisor.
+ * @param iomem		Top-level entries of the iomem resource tree.
+ * @param num_iomem	Number of entries.
+ * @param reserved	Hypervisor memory, cut out of the "Reserved" entry
+ *			containing it. Entries named JAILHOUSE_IOMEM_HYPERVISOR
+ *			are left out as well.
+ * @param regions	Output, room for num_iomem + 1 entries.
+ *
+ * The start and end addr of memory regions must be PAGE_SIZE align.
+ *
+ * @return Number of regions, -1 if the reserved region overlaps other
+ * memory.
+ */
+int jailhouse_get_mem_regions(
+	const struct jailhouse_iomem_entry *iomem, int num_iomem,
+	const struct mem_region *reserved, struct jailhouse_memory *regions)
+{
+	struct mem_region region;
+	int n, num = 0;
+
+	for (n = 0; n < num_iomem; n++)
+	{
+		if (!strcmp(iomem[n].name, JAILHOUSE_IOMEM_HYPERVISOR))
+			continue;
+		region.start = iomem[n].start;
+		region.size = iomem[n].end - iomem[n].start + 1;
+		pr_debug(
+			"found region: %s [0x%llx..0x%llx]\n", iomem[n].name, region.start,
+			region.start + region.size - 1);
+		if (!get_mem_region_one(
+				&region, iomem[n].name, reserved, regions, &num))
+		{
+			return -1;
+		}
+	}
+	return num;
+}
+
+/*
+ * Adjacent regions can share stage-2 mappings if their flags are equal.
+ * Merging others would give one of them rights it does not have, like DMA
+ * to reserved memory next to RAM.
+ */
+static bool mem_regions_compatible(
+	const struct jailhouse_memory *a, const struct jailhouse_memory *b)
+{
+	return a->phys_start + a->size == b->phys_start && a->flags == b->flags;
+}
+
+static int coalesce_mem_regions(struct jailhouse_memory *regions, int num)
+{
+	int n, last = 0;
+
+	for (n = 1; n < num; n++)
+	{
+		if (mem_regions_compatible(&regions[last], &regions[n]))
+			regions[last].size += regions[n].size;
+		else
+			regions[++last] = regions[n];
+	}
+	return num ? last + 1 : 0;
+}
+
+static void add_mem_region_part(
+	struct jailhouse_memory *regions, int *num, unsigned long long start,
+	unsigned long long end, unsigned long long flags)
+{
+	if (start == end)
+		return;
+	regions[*num].phys_start = start;
+	regions[*num].virt_start = start;
+	regions[*num].size = end - start;
+	regions[*num].flags = flags;
+	(*num)++;
+}
+
+/*
+ * Split a region at 2M and 1G boundaries so that each part can be mapped
+ * with a single page size, and tag the parts with that size.
+ */
+static void split_mem_region(
+	const struct jailhouse_memory *region, struct jailhouse_memory *out,
+	int *num)
+{
+	unsigned long long s = region->phys_start;
+	unsigned long long e = s + region->size;
+	unsigned long long flags = region->flags;
+	unsigned long long s2 = round_up(s, SZ_2M), e2 = round_down(e, SZ_2M);
+	unsigned long long s1, e1;
+
+	if ((flags & JAILHOUSE_MEM_NO_HUGEPAGES) || s2 >= e2)
+	{
+		add_mem_region_part(out, num, s, e, flags | JAILHOUSE_MEM_NO_HUGEPAGES);
+		return;
+	}
+
+	add_mem_region_part(out, num, s, s2, flags | JAILHOUSE_MEM_NO_HUGEPAGES);
+	s1 = round_up(s2, SZ_1G);
+	e1 = round_down(e2, SZ_1G);
+	if (s1 < e1)
+	{
+		add_mem_region_part(out, num, s2, s1, flags | JAILHOUSE_MEM_HINT_2M);
+		add_mem_region_part(out, num, s1, e1, flags | JAILHOUSE_MEM_HINT_1G);
+		add_mem_region_part(out, num, e1, e2, flags | JAILHOUSE_MEM_HINT_2M);
+	}
+	else
+		add_mem_region_part(out, num, s2, e2, flags | JAILHOUSE_MEM_HINT_2M);
+	add_mem_region_part(out, num, e2, e, flags | JAILHOUSE_MEM_NO_HUGEPAGES);
+}
+
+static unsigned long long
+count_2m_pages(unsigned long long s, unsigned long long e)
+{
+	unsigned long long s2 = round_up(s, SZ_2M), e2 = round_down(e, SZ_2M);
+
+	if (s2 >= e2)
+		return (e - s) / PAGE_SIZE;
+	return (e2 - s2) / SZ_2M + (s2 - s) / PAGE_SIZE + (e - e2) / PAGE_SIZE;
+}
+
+/*
+ * Estimate the stage-2 leaf entries needed for the regions when each is
+ * mapped with the page size of its hint, or else the largest pages that
+ * fit.
+ */
+static unsigned long long
+estimate_ept_entries(const struct jailhouse_memory *regions, int num)
+{
+	unsigned long long entries = 0, s, e, s1, e1;
+	int n;
+
+	for (n = 0; n < num; n++)
+	{
+		s = regions[n].phys_start;
+		e = s + regions[n].size;
+		if (regions[n].flags & JAILHOUSE_MEM_NO_HUGEPAGES)
+		{
+			entries += (e - s) / PAGE_SIZE;
+			continue;
+		}
+		if (regions[n].flags & JAILHOUSE_MEM_HINT_1G)
+		{
+			entries += (e - s) / SZ_1G;
+			continue;
+		}
+		if (regions[n].flags & JAILHOUSE_MEM_HINT_2M)
+		{
+			entries += (e - s) / SZ_2M;
+			continue;
+		}
+		s1 = round_up(s, SZ_1G);
+		e1 = round_down(e, SZ_1G);
+		if (s1 < e1)
+			entries += (e1 - s1) / SZ_1G + count_2m_pages(s, s1) +
+					   count_2m_pages(e1, e);
+		else
+			entries += count_2m_pages(s, e);
+	}
+	return entries;
+}
+
+/**
+ * Coalesce compatible neighbours, then split at huge page boundaries so
+ * that the root cell can be mapped with the fewest and largest pages.
+ * @param regions	Regions as returned by jailhouse_get_mem_regions(),
+ *			coalesced in place.
+ * @param num		Number of regions.
+ * @param out		Output, room for JAILHOUSE_MEM_REGION_MAX_SPLIT * num
+ *			entries.
+ * @param stats		Output, region and stage-2 entry counts before and
+ *			after, may be NULL.
+ *
+ * @return Number of regions in @c out.
+ */
+int jailhouse_optimize_mem_regions(
+	struct jailhouse_memory *regions, int num, struct jailhouse_memory *out,
+	struct jailhouse_layout_stats *stats)
+{
+	int merged, n, num_out = 0;
+
+	if (stats)
+	{
+		stats->regions_before = num;
+		stats->entries_before = estimate_ept_entries(regions, num);
+	}
+
+	merged = coalesce_mem_regions(regions, num);
+	for (n = 0; n < merged; n++)
+		split_mem_region(&regions[n], out, &num_out);
+
+	if (stats)
+	{
+		stats->regions_coalesced = merged;
+		stats->regions_after = num_out;
+		stats->entries_after = estimate_ept_entries(out, num_out);
+	}
+
+	return num_out;
+}
+
+/**
+ * Fill in the system configuration, followed by the root cell's memory
+ * regions and the topology tables. @c config must have room for
+ * jailhouse_system_config_bytes().
+ */
+void jailhouse_init_system_config(
+	struct jailhouse_system *config, const struct mem_region *hv_region,
+	const struct mem_region *rt_region, int num_mem_regions,
+	const struct jailhouse_memory *mem_regions,
+	const struct jailhouse_topology *topology)
+{
+	void *tables;
+
+	memset(config, 0, sizeof(*config));
+
+	memcpy(
+		config->signature, JAILHOUSE_SYSTEM_SIGNATURE,
+		sizeof(config->signature));
+	config->revision = JAILHOUSE_CONFIG_REVISION;
+	config->hypervisor_memory.phys_start = hv_region->start;
+	config->hypervisor_memory.size = hv_region->size;
+	config->rtos_memory.phys_start = rt_region->start;
+	config->rtos_memory.size = rt_region->size;
+	config->num_numa_nodes = topology->num_nodes;
+	config->num_cpus = topology->num_cpus;
+	memcpy(
+		config->root_cell.signature, JAILHOUSE_CELL_DESC_SIGNATURE,
+		sizeof(config->root_cell.signature));
+	config->root_cell.revision = JAILHOUSE_CONFIG_REVISION;
+	strcpy(config->root_cell.name, "linux-root-cell");
+	config->root_cell.id = 0;
+	config->root_cell.num_memory_regions = num_mem_regions;
+
+	memcpy(
+		(void *)config + sizeof(*config), mem_regions,
+		sizeof(*mem_regions) * num_mem_regions);
+
+	tables = (void *)config + sizeof(*config) +
+			 sizeof(*mem_regions) * num_mem_regions;
+	if (topology->num_nodes)
+		memcpy(
+			tables, topology->nodes,
+			topology->num_nodes * sizeof(*topology->nodes));
+	tables += topology->num_nodes * sizeof(*topology->nodes);
+	if (topology->num_cpus)
+		memcpy(
+			tables, topology->cpu_node,
+			topology->num_cpus * sizeof(*topology->cpu_node));
+}
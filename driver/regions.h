@@ -0,0 +1,70 @@
+#ifndef _JAILHOUSE_REGIONS_H
+#define _JAILHOUSE_REGIONS_H
+
+#include "jailhouse.h"
+
+#include "cell-config.h"
+
+/* A region is split into at most a 4K, 2M, 1G, 2M and 4K part. */
+#define JAILHOUSE_MEM_REGION_MAX_SPLIT 5
+
+/* Name of iomem entries the root cell gets no access to at all */
+#define JAILHOUSE_IOMEM_HYPERVISOR "Jailhouse hypervisor"
+
+/* Top-level entry of the iomem resource tree */
+struct jailhouse_iomem_entry
+{
+	unsigned long long start;
+	/* inclusive, like struct resource */
+	unsigned long long end;
+	const char *name;
+};
+
+/* CPU and NUMA topology to describe in the system configuration */
+struct jailhouse_topology
+{
+	unsigned int num_nodes;
+	unsigned int num_cpus;
+	const struct jailhouse_numa_node *nodes;
+	/* node of each CPU */
+	const __u32 *cpu_node;
+};
+
+struct jailhouse_layout_stats
+{
+	int regions_before;
+	int regions_coalesced;
+	int regions_after;
+	unsigned long long entries_before;
+	unsigned long long entries_after;
+};
+
+/*
+ * Size of the system configuration built by jailhouse_init_system_config(),
+ * also used by the tool to size the hypervisor memory
+ */
+static inline unsigned long jailhouse_system_config_bytes(
+	int num_mem_regions, const struct jailhouse_topology *topology)
+{
+	return sizeof(struct jailhouse_system) +
+		   num_mem_regions * sizeof(struct jailhouse_memory) +
+		   topology->num_nodes * sizeof(struct jailhouse_numa_node) +
+		   topology->num_cpus * sizeof(__u32);
+}
+
+int jailhouse_iomem_carve(
+	struct jailhouse_iomem_entry *iomem, int num,
+	const struct mem_region *region, const char *name);
+int jailhouse_get_mem_regions(
+	const struct jailhouse_iomem_entry *iomem, int num_iomem,
+	const struct mem_region *reserved, struct jailhouse_memory *regions);
+int jailhouse_optimize_mem_regions(
+	struct jailhouse_memory *regions, int num, struct jailhouse_memory *out,
+	struct jailhouse_layout_stats *stats);
+void jailhouse_init_system_config(
+	struct jailhouse_system *config, const struct mem_region *hv_region,
+	const struct mem_region *rt_region, int num_mem_regions,
+	const struct jailhouse_memory *mem_regions,
+	const struct jailhouse_topology *topology);
+
+#endif /* !_JAILHOUSE_REGIONS_H */
@@ -0,0 +1,264 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Running the hypervisor entry and exit on a set of CPUs at once. Instead
+ * of one IPI per CPU from the caller and a counter shared by all of them,
+ * the caller kicks one CPU per NUMA node, which kicks the others of its
+ * node. Each CPU reports in its own slot and to a counter of its node, and
+ * only the last CPU of a node touches the counter the caller waits on.
+ * The wait is bounded, CPUs that do not report back in time are named.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#include <linux/atomic.h>
+#include <linux/cache.h>
+#include <linux/irqflags.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/nodemask.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
+#include <linux/smp.h>
+#include <linux/string.h>
+#include <linux/topology.h>
+
+#include "rendezvous.h"
+
+#ifndef INIT_CSD
+#define INIT_CSD(_csd, _func, _info)                                           \
+	do                                                                         \
+	{                                                                          \
+		(_csd)->func = (_func);                                                \
+		(_csd)->info = (_info);                                                \
+	} while (0)
+#endif
+
+static unsigned int rendezvous_timeout_ms = 5000;
+module_param(rendezvous_timeout_ms, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(
+	rendezvous_timeout_ms,
+	"Time the CPUs get to enter or leave the hypervisor (0: no limit)");
+
+static char *rendezvous_order = "node";
+module_param(rendezvous_order, charp, S_IRUGO);
+MODULE_PARM_DESC(
+	rendezvous_order,
+	"Order the CPUs are kicked in: \"node\" (one CPU per node kicks the "
+	"rest of its node) or \"cpu\" (the caller kicks all in CPU order)");
+
+enum rendezvous_state
+{
+	RENDEZVOUS_QUEUED = 1,
+	RENDEZVOUS_RUNNING,
+	RENDEZVOUS_DONE,
+};
+
+struct rendezvous_slot
+{
+	call_single_data_t csd;
+	/* kicks the other CPUs of its node before running the function */
+	bool leader;
+	int state;
+	int err;
+};
+
+struct rendezvous_node
+{
+	/* CPUs of the node that have not reported yet */
+	atomic_t pending;
+} ____cacheline_aligned_in_smp;
+
+static DEFINE_PER_CPU_SHARED_ALIGNED(struct rendezvous_slot, rendezvous_slots);
+static struct rendezvous_node *rendezvous_nodes;
+/* Nodes with CPUs that have not reported yet */
+static atomic_t rendezvous_nodes_pending;
+
+static const struct cpumask *rendezvous_cpus;
+static jailhouse_rendezvous_fn rendezvous_func;
+static void *rendezvous_info;
+/* Set after a timeout: stragglers may still use the slots */
+static bool rendezvous_broken;
+/* CPUs that did not report and, of those, did not start in time */
+static cpumask_t rendezvous_late, rendezvous_unstarted;
+
+/* Node of a CPU, CPUs without one count to the first online node. */
+static int rendezvous_node_of(unsigned int cpu)
+{
+	int node = cpu_to_node(cpu);
+
+	return node == NUMA_NO_NODE ? first_online_node : node;
+}
+
+static void rendezvous_kick(unsigned int cpu)
+{
+	smp_call_function_single_async(
+		cpu, &per_cpu_ptr(&rendezvous_slots, cpu)->csd);
+}
+
+static void rendezvous_run(void *unused)
+{
+	struct rendezvous_slot *slot = this_cpu_ptr(&rendezvous_slots);
+	unsigned int self = smp_processor_id(), cpu;
+	int node = rendezvous_node_of(self);
+
+	/* not cpumask_of_node(), which misses the CPUs without a node */
+	if (slot->leader)
+		for_each_cpu(cpu, rendezvous_cpus)
+			if (cpu != self && rendezvous_node_of(cpu) == node)
+				rendezvous_kick(cpu);
+
+	WRITE_ONCE(slot->state, RENDEZVOUS_RUNNING);
+	slot->err = rendezvous_func(rendezvous_info);
+	smp_store_release(&slot->state, RENDEZVOUS_DONE);
+
+	if (atomic_dec_and_test(&rendezvous_nodes[node].pending))
+		atomic_dec(&rendezvous_nodes_pending);
+}
+
+/* Pick the CPU kicking the others of a node, the caller on its own node. */
+static unsigned int
+rendezvous_leader(const struct cpumask *cpus, int node, unsigned int self)
+{
+	unsigned int cpu;
+
+	if (cpumask_test_cpu(self, cpus) && rendezvous_node_of(self) == node)
+		return self;
+	for_each_cpu(cpu, cpus)
+		if (rendezvous_node_of(cpu) == node)
+			return cpu;
+	return nr_cpu_ids;
+}
+
+static void rendezvous_report(const struct cpumask *cpus)
+{
+	struct rendezvous_slot *slot;
+	unsigned int cpu;
+	int state;
+
+	cpumask_clear(&rendezvous_late);
+	cpumask_clear(&rendezvous_unstarted);
+	for_each_cpu(cpu, cpus)
+	{
+		slot = per_cpu_ptr(&rendezvous_slots, cpu);
+		state = smp_load_acquire(&slot->state);
+		if (state != RENDEZVOUS_DONE)
+			cpumask_set_cpu(cpu, &rendezvous_late);
+		if (state == RENDEZVOUS_QUEUED)
+			cpumask_set_cpu(cpu, &rendezvous_unstarted);
+	}
+	pr_err(
+		"jailhouse: CPUs %*pbl did not return within %u ms, %*pbl of them "
+		"did not start\n",
+		cpumask_pr_args(&rendezvous_late), rendezvous_timeout_ms,
+		cpumask_pr_args(&rendezvous_unstarted));
+}
+
+/**
+ * Run a function on a set of CPUs, including the caller's if it is in the
+ * set, and wait for all of them to return. Must be called with preemption
+ * disabled. The caller runs the function last, after kicking the others.
+ * @param cpus		CPUs to run @c fn on, online and stable.
+ * @param fn		Function to run, interrupts disabled.
+ * @param info		Argument of @c fn.
+ *
+ * @return 0 if @c fn returned 0 on all CPUs, otherwise the first error in
+ * CPU order. -ETIMEDOUT if not all CPUs returned within
+ * rendezvous_timeout_ms; stragglers may still run @c fn afterwards, so all
+ * further rendezvous fail with -EIO.
+ */
+int jailhouse_rendezvous(
+	const struct cpumask *cpus, jailhouse_rendezvous_fn fn, void *info)
+{
+	bool by_node = strcmp(rendezvous_order, "cpu") != 0;
+	unsigned int self = smp_processor_id(), cpu, num_nodes = 0;
+	struct rendezvous_slot *slot;
+	unsigned long flags;
+	u64 deadline;
+	int node, err = 0;
+
+	if (rendezvous_broken)
+		return -EIO;
+
+	rendezvous_cpus = cpus;
+	rendezvous_func = fn;
+	rendezvous_info = info;
+	for_each_node(node)
+		atomic_set(&rendezvous_nodes[node].pending, 0);
+	for_each_cpu(cpu, cpus)
+	{
+		slot = per_cpu_ptr(&rendezvous_slots, cpu);
+		INIT_CSD(&slot->csd, rendezvous_run, NULL);
+		slot->leader = false;
+		slot->state = RENDEZVOUS_QUEUED;
+		slot->err = 0;
+		node = rendezvous_node_of(cpu);
+		if (atomic_inc_return(&rendezvous_nodes[node].pending) == 1)
+			num_nodes++;
+	}
+	atomic_set(&rendezvous_nodes_pending, num_nodes);
+
+	/* slots are set up before the IPIs carrying them out */
+	smp_wmb();
+	if (by_node)
+	{
+		for_each_node(node)
+		{
+			cpu = rendezvous_leader(cpus, node, self);
+			if (cpu >= nr_cpu_ids)
+				continue;
+			per_cpu_ptr(&rendezvous_slots, cpu)->leader = true;
+			if (cpu != self)
+				rendezvous_kick(cpu);
+		}
+	}
+	else
+	{
+		for_each_cpu(cpu, cpus)
+			if (cpu != self)
+				rendezvous_kick(cpu);
+	}
+
+	if (cpumask_test_cpu(self, cpus))
+	{
+		local_irq_save(flags);
+		rendezvous_run(NULL);
+		local_irq_restore(flags);
+	}
+
+	deadline = ktime_get_ns() + (u64)rendezvous_timeout_ms * NSEC_PER_MSEC;
+	while (atomic_read(&rendezvous_nodes_pending))
+	{
+		if (rendezvous_timeout_ms && ktime_get_ns() > deadline)
+		{
+			rendezvous_broken = true;
+			rendezvous_report(cpus);
+			return -ETIMEDOUT;
+		}
+		cpu_relax();
+	}
+
+	for_each_cpu(cpu, cpus)
+	{
+		slot = per_cpu_ptr(&rendezvous_slots, cpu);
+		if (slot->err)
+		{
+			err = slot->err;
+			break;
+		}
+	}
+	return err;
+}
+
+int jailhouse_rendezvous_init(void)
+{
+	rendezvous_nodes =
+		kcalloc(nr_node_ids, sizeof(*rendezvous_nodes), GFP_KERNEL);
+	return rendezvous_nodes ? 0 : -ENOMEM;
+}
+
+void jailhouse_rendezvous_exit(void)
+{
+	kfree(rendezvous_nodes);
+}
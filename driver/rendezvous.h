@@ -0,0 +1,14 @@
+#ifndef _JAILHOUSE_RENDEZVOUS_H
+#define _JAILHOUSE_RENDEZVOUS_H
+
+#include <linux/cpumask.h>
+
+/* Called on each CPU of the rendezvous with interrupts disabled */
+typedef int (*jailhouse_rendezvous_fn)(void *info);
+
+int jailhouse_rendezvous_init(void);
+void jailhouse_rendezvous_exit(void);
+int jailhouse_rendezvous(
+	const struct cpumask *cpus, jailhouse_rendezvous_fn fn, void *info);
+
+#endif /* !_JAILHOUSE_RENDEZVOUS_H */
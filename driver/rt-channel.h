@@ -0,0 +1,259 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Lock-free single-producer/single-consumer channels in memory shared with
+ * the RT partition, usually rt_region. Header-only, for the kernel (map
+ * the memory with jailhouse_rt_memremap()) and for userspace (mmap
+ * /dev/jailhouse). The layout is fixed by struct jailhouse_rt_channel so
+ * that the RTOS can implement the other end.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#ifndef _JAILHOUSE_RT_CHANNEL_H
+#define _JAILHOUSE_RT_CHANNEL_H
+
+#if defined(__KERNEL__) && !defined(JAILHOUSE_USERSPACE)
+#include <asm/barrier.h>
+#include <linux/compiler.h>
+#include <linux/errno.h>
+#include <linux/string.h>
+#include <linux/types.h>
+
+#define jailhouse_rt_load_acquire(p) smp_load_acquire(p)
+#define jailhouse_rt_store_release(p, v) smp_store_release(p, v)
+#define jailhouse_rt_load_relaxed(p) READ_ONCE(*(p))
+
+/* Map part of rt_region write-back cached, NULL if it is not available. */
+void *jailhouse_rt_memremap(unsigned long long offset, unsigned long size);
+void jailhouse_rt_memunmap(void *addr);
+#else /* userspace */
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+#include <linux/types.h>
+
+#define jailhouse_rt_load_acquire(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define jailhouse_rt_store_release(p, v)                                       \
+	__atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define jailhouse_rt_load_relaxed(p) __atomic_load_n(p, __ATOMIC_RELAXED)
+#endif
+
+/* "JHCH" */
+#define JAILHOUSE_RT_CHANNEL_MAGIC 0x4843484a
+/* Incremented on any change of struct jailhouse_rt_channel or its use. */
+#define JAILHOUSE_RT_CHANNEL_VERSION 1
+#define JAILHOUSE_RT_CACHELINE 64
+
+/**
+ * Channel header, followed by num_slots slots of slot_size bytes. The
+ * producer and the consumer index each live in a cache line of their own
+ * and are only written by their owner. Both run freely, slot n is at
+ * n % num_slots, and the channel is full when head - tail == num_slots.
+ */
+struct jailhouse_rt_channel
+{
+	/** Written last by jailhouse_rt_channel_init(). */
+	__u32 magic;
+	__u32 version;
+	/** Bytes per slot, a multiple of 8. */
+	__u32 slot_size;
+	/** Number of slots, a power of two. */
+	__u32 num_slots;
+	__u8 reserved0[JAILHOUSE_RT_CACHELINE - 16];
+	/** Slots enqueued so far, written by the producer. */
+	__u32 head;
+	__u8 reserved1[JAILHOUSE_RT_CACHELINE - 4];
+	/** Slots dequeued so far, written by the consumer. */
+	__u32 tail;
+	__u8 reserved2[JAILHOUSE_RT_CACHELINE - 4];
+};
+
+/**
+ * Local state of one end of a channel. Caches the peer's index so that its
+ * cache line is only read when the cached value does not suffice.
+ */
+struct jailhouse_rt_endpoint
+{
+	struct jailhouse_rt_channel *channel;
+	__u8 *slots;
+	__u32 slot_size;
+	__u32 mask;
+	/** Own index: head for the producer, tail for the consumer. */
+	__u32 index;
+	/** Last seen index of the peer. */
+	__u32 peer;
+};
+
+static inline unsigned long
+jailhouse_rt_channel_size(__u32 slot_size, __u32 num_slots)
+{
+	return sizeof(struct jailhouse_rt_channel) +
+		   (unsigned long)slot_size * num_slots;
+}
+
+/**
+ * Format a channel. Must be done by one side before both attach.
+ * @param mem		Shared memory, aligned to JAILHOUSE_RT_CACHELINE.
+ * @param size		Size of @c mem.
+ * @param slot_size	Bytes per slot, a multiple of 8.
+ * @param num_slots	Number of slots, a power of two.
+ *
+ * @return 0 on success, -EINVAL if the parameters are invalid or the
+ * channel does not fit.
+ */
+static inline int jailhouse_rt_channel_init(
+	void *mem, unsigned long size, __u32 slot_size, __u32 num_slots)
+{
+	struct jailhouse_rt_channel *channel = mem;
+
+	if (!slot_size || slot_size % 8 || !num_slots ||
+		(num_slots & (num_slots - 1)) ||
+		(unsigned long)mem % JAILHOUSE_RT_CACHELINE ||
+		size < jailhouse_rt_channel_size(slot_size, num_slots))
+		return -EINVAL;
+
+	memset(channel, 0, sizeof(*channel));
+	channel->version = JAILHOUSE_RT_CHANNEL_VERSION;
+	channel->slot_size = slot_size;
+	channel->num_slots = num_slots;
+	jailhouse_rt_store_release(&channel->magic, JAILHOUSE_RT_CHANNEL_MAGIC);
+	return 0;
+}
+
+static inline int jailhouse_rt_attach(
+	struct jailhouse_rt_endpoint *ep, void *mem, unsigned long size,
+	int producer)
+{
+	struct jailhouse_rt_channel *channel = mem;
+
+	if (size < sizeof(*channel) ||
+		jailhouse_rt_load_acquire(&channel->magic) !=
+			JAILHOUSE_RT_CHANNEL_MAGIC)
+		return -ENODEV;
+	if (channel->version != JAILHOUSE_RT_CHANNEL_VERSION ||
+		size < jailhouse_rt_channel_size(
+				   channel->slot_size, channel->num_slots))
+		return -EINVAL;
+
+	ep->channel = channel;
+	ep->slots = (__u8 *)mem + sizeof(*channel);
+	ep->slot_size = channel->slot_size;
+	ep->mask = channel->num_slots - 1;
+	if (producer)
+	{
+		ep->index = jailhouse_rt_load_relaxed(&channel->head);
+		ep->peer = jailhouse_rt_load_acquire(&channel->tail);
+	}
+	else
+	{
+		ep->index = jailhouse_rt_load_relaxed(&channel->tail);
+		ep->peer = jailhouse_rt_load_acquire(&channel->head);
+	}
+	return 0;
+}
+
+/** Attach as the producer of a formatted channel. */
+static inline int jailhouse_rt_attach_producer(
+	struct jailhouse_rt_endpoint *ep, void *mem, unsigned long size)
+{
+	return jailhouse_rt_attach(ep, mem, size, 1);
+}
+
+/** Attach as the consumer of a formatted channel. */
+static inline int jailhouse_rt_attach_consumer(
+	struct jailhouse_rt_endpoint *ep, void *mem, unsigned long size)
+{
+	return jailhouse_rt_attach(ep, mem, size, 0);
+}
+
+/* Copy num slots between a linear buffer and the ring, starting at index. */
+static inline void jailhouse_rt_copy(
+	const struct jailhouse_rt_endpoint *ep, __u32 index, void *buf,
+	unsigned int num, int to_ring)
+{
+	__u32 first = index & ep->mask;
+	__u32 chunk = ep->mask + 1 - first;
+	unsigned long bytes;
+
+	if (chunk > num)
+		chunk = num;
+	bytes = (unsigned long)chunk * ep->slot_size;
+	if (to_ring)
+		memcpy(ep->slots + (unsigned long)first * ep->slot_size, buf, bytes);
+	else
+		memcpy(buf, ep->slots + (unsigned long)first * ep->slot_size, bytes);
+
+	if (chunk < num)
+	{
+		buf = (__u8 *)buf + bytes;
+		bytes = (unsigned long)(num - chunk) * ep->slot_size;
+		if (to_ring)
+			memcpy(ep->slots, buf, bytes);
+		else
+			memcpy(buf, ep->slots, bytes);
+	}
+}
+
+/**
+ * Enqueue up to @c num slots, published to the consumer at once.
+ * @param ep		Producer endpoint.
+ * @param data		@c num * slot_size bytes.
+ * @param num		Number of slots to enqueue.
+ *
+ * @return Number of slots enqueued, less than @c num if the channel is
+ * full.
+ */
+static inline unsigned int jailhouse_rt_enqueue(
+	struct jailhouse_rt_endpoint *ep, const void *data, unsigned int num)
+{
+	__u32 free = ep->mask + 1 - (ep->index - ep->peer);
+
+	if (free < num)
+	{
+		ep->peer = jailhouse_rt_load_acquire(&ep->channel->tail);
+		free = ep->mask + 1 - (ep->index - ep->peer);
+		if (free < num)
+			num = free;
+	}
+	if (!num)
+		return 0;
+
+	jailhouse_rt_copy(ep, ep->index, (void *)data, num, 1);
+	ep->index += num;
+	jailhouse_rt_store_release(&ep->channel->head, ep->index);
+	return num;
+}
+
+/**
+ * Dequeue up to @c num slots, released to the producer at once.
+ * @param ep		Consumer endpoint.
+ * @param data		Room for @c num * slot_size bytes.
+ * @param num		Number of slots to dequeue.
+ *
+ * @return Number of slots dequeued, less than @c num if the channel ran
+ * empty.
+ */
+static inline unsigned int jailhouse_rt_dequeue(
+	struct jailhouse_rt_endpoint *ep, void *data, unsigned int num)
+{
+	__u32 used = ep->peer - ep->index;
+
+	if (used < num)
+	{
+		ep->peer = jailhouse_rt_load_acquire(&ep->channel->head);
+		used = ep->peer - ep->index;
+		if (used < num)
+			num = used;
+	}
+	if (!num)
+		return 0;
+
+	jailhouse_rt_copy(ep, ep->index, data, num, 0);
+	ep->index += num;
+	jailhouse_rt_store_release(&ep->channel->tail, ep->index);
+	return num;
+}
+
+#endif /* !_JAILHOUSE_RT_CHANNEL_H */
@@ -0,0 +1,134 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Selection of the CPUs handed to the RT partition. Besides the RT CPUs
+ * themselves, the isolation policies of JAILHOUSE_ENABLE_RT_ISOLATE_* take
+ * their SMT siblings or LLC domains away from Linux. Those CPUs are parked:
+ * offlined like the RT CPUs, but left idle.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#include <linux/cpu.h>
+#include <linux/cpumask.h>
+#include <linux/kernel.h>
+#include <linux/topology.h>
+
+#include "jailhouse.h"
+#include "rt-cpus.h"
+
+#ifdef CONFIG_X86
+#define rt_llc_mask(cpu) cpu_llc_shared_mask(cpu)
+#else
+/* there is no generic LLC mask, the package is the closest superset */
+#define rt_llc_mask(cpu) topology_core_cpumask(cpu)
+#endif
+
+/* The CPUs that must not be shared with Linux if cpu runs the RTOS. */
+static void rt_isolated_mask(
+	unsigned int cpu, unsigned int flags, struct cpumask *mask)
+{
+	cpumask_copy(mask, cpumask_of(cpu));
+	if (flags & JAILHOUSE_ENABLE_RT_ISOLATE_SMT)
+		cpumask_or(mask, mask, topology_sibling_cpumask(cpu));
+	if (flags & JAILHOUSE_ENABLE_RT_ISOLATE_LLC)
+		cpumask_or(mask, mask, rt_llc_mask(cpu));
+}
+
+/* Whether cpu may become an RT CPU next to the ones in rt. */
+static bool rt_cpu_eligible(
+	unsigned int cpu, unsigned int flags, const struct cpumask *rt)
+{
+	/* Linux cannot give up CPU 0 on all architectures */
+	if (cpu == 0 || cpumask_test_cpu(cpu, rt))
+		return false;
+	return !(flags & JAILHOUSE_ENABLE_RT_ISOLATE_SMT) ||
+		   !cpumask_intersects(topology_sibling_cpumask(cpu), rt);
+}
+
+/*
+ * Pick count CPUs from the top. CPUs already parked are preferred, so that
+ * RT CPUs share the LLC domains taken from Linux anyway, before a new
+ * domain is claimed.
+ */
+static int rt_cpus_pick(
+	unsigned int count, unsigned int flags, struct cpumask *rt,
+	struct cpumask *parked, struct cpumask *isolated)
+{
+	int cpu, best;
+
+	while (cpumask_weight(rt) < count)
+	{
+		best = -1;
+		for_each_cpu(cpu, parked)
+			if (rt_cpu_eligible(cpu, flags, rt))
+				best = cpu;
+
+		for (cpu = nr_cpu_ids - 1; best < 0 && cpu >= 0; cpu--)
+		{
+			if (!cpu_online(cpu) || cpumask_test_cpu(cpu, parked) ||
+				!rt_cpu_eligible(cpu, flags, rt))
+				continue;
+			rt_isolated_mask(cpu, flags, isolated);
+			if (!cpumask_test_cpu(0, isolated))
+				best = cpu;
+		}
+		if (best < 0)
+			return -ENOSPC;
+
+		rt_isolated_mask(best, flags, isolated);
+		cpumask_or(parked, parked, isolated);
+		cpumask_set_cpu(best, rt);
+	}
+	return 0;
+}
+
+/**
+ * Select the RT CPUs and the CPUs to park next to them.
+ * @param requested	RT CPUs chosen by the user, NULL to pick @c count.
+ * @param count		Number of RT CPUs to pick.
+ * @param flags		JAILHOUSE_ENABLE_RT_ISOLATE_* policy.
+ * @param rt		Returns the RT CPUs.
+ * @param parked	Returns the other CPUs to take away from Linux.
+ *
+ * @return 0 on success, -EINVAL if @c requested cannot be isolated,
+ * -ENOSPC if not enough CPUs can be isolated.
+ */
+int jailhouse_rt_cpus_select(
+	const struct cpumask *requested, unsigned int count, unsigned int flags,
+	struct cpumask *rt, struct cpumask *parked)
+{
+	cpumask_var_t isolated;
+	unsigned int cpu;
+	int err = 0;
+
+	if (!zalloc_cpumask_var(&isolated, GFP_KERNEL))
+		return -ENOMEM;
+
+	cpumask_clear(rt);
+	cpumask_clear(parked);
+
+	/* The topology masks only cover online CPUs. */
+	cpus_read_lock();
+	if (requested)
+	{
+		cpumask_copy(rt, requested);
+		for_each_cpu(cpu, requested)
+		{
+			rt_isolated_mask(cpu, flags, isolated);
+			cpumask_or(parked, parked, isolated);
+		}
+		if (!cpumask_subset(rt, cpu_online_mask) ||
+			cpumask_test_cpu(0, parked))
+			err = -EINVAL;
+	}
+	else
+		err = rt_cpus_pick(count, flags, rt, parked, isolated);
+	cpus_read_unlock();
+
+	cpumask_andnot(parked, parked, rt);
+	cpumask_and(parked, parked, cpu_online_mask);
+	free_cpumask_var(isolated);
+	return err;
+}
@@ -0,0 +1,10 @@
+#ifndef _JAILHOUSE_RT_CPUS_H
+#define _JAILHOUSE_RT_CPUS_H
+
+#include <linux/cpumask.h>
+
+int jailhouse_rt_cpus_select(
+	const struct cpumask *requested, unsigned int count, unsigned int flags,
+	struct cpumask *rt, struct cpumask *parked);
+
+#endif /* !_JAILHOUSE_RT_CPUS_H */
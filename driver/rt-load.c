@@ -0,0 +1,134 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Loading of the RTOS image into rt_region. The file is read straight into
+ * a mapping of the destination, so the data is copied once, from the page
+ * cache, and only the part of the image after the file data is cleared.
+ * Splicing would not save that copy: the page cache pages cannot become
+ * rt_region, whether it is reserved memory or has struct pages from CMA.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#include <linux/fadvise.h>
+#include <linux/file.h>
+#include <linux/fs.h>
+#include <linux/kernel.h>
+#include <linux/math64.h>
+#include <linux/sched/signal.h>
+#include <linux/sizes.h>
+#include <linux/string.h>
+#include <linux/timekeeping.h>
+
+#include "rt-channel.h"
+#include "rt-load.h"
+#include "rt-mmap.h"
+
+/* Read in chunks to stay responsive to signals on large images. */
+#define RT_LOAD_CHUNK SZ_4M
+
+static int rt_load_read(
+	struct file *file, void *dst, unsigned long long size, loff_t pos)
+{
+	unsigned long long done = 0;
+	ssize_t ret;
+
+	while (done < size)
+	{
+		ret = kernel_read(
+			file, dst + done, min_t(u64, size - done, RT_LOAD_CHUNK), &pos);
+		if (ret < 0)
+			return ret;
+		/* file got shorter under us */
+		if (ret == 0)
+			return -EIO;
+		done += ret;
+
+		if (fatal_signal_pending(current))
+			return -EINTR;
+		cond_resched();
+	}
+	return 0;
+}
+
+/**
+ * Load an image as described by @c load and fill in its results. No lock
+ * is needed, rt_region cannot be freed while it is mapped for the load.
+ *
+ * @return 0 on success, negative error code otherwise.
+ */
+int jailhouse_rt_load(struct jailhouse_load_rt *load)
+{
+	unsigned long long file_size, mem_size;
+	struct mem_region region;
+	struct file *file;
+	loff_t i_size;
+	u64 start;
+	void *dst;
+	int err;
+
+	file = fget(load->fd);
+	if (!file)
+		return -EBADF;
+	if (!(file->f_mode & FMODE_READ))
+	{
+		err = -EBADF;
+		goto out_put;
+	}
+
+	i_size = i_size_read(file_inode(file));
+	if (load->file_offset > i_size)
+	{
+		err = -EINVAL;
+		goto out_put;
+	}
+	file_size = load->file_size ?: i_size - load->file_offset;
+	mem_size = load->mem_size ?: file_size;
+	if (!file_size || file_size > i_size - load->file_offset ||
+		mem_size < file_size || load->entry < load->rt_offset ||
+		load->entry - load->rt_offset >= mem_size)
+	{
+		err = -EINVAL;
+		goto out_put;
+	}
+
+	dst = jailhouse_rt_memremap_region(load->rt_offset, mem_size, &region);
+	if (!dst)
+	{
+		if (!region.size)
+			err = -ENODEV;
+		else if (
+			load->rt_offset >= region.size ||
+			mem_size > region.size - load->rt_offset)
+			err = -EINVAL;
+		else
+			err = -ENOMEM;
+		goto out_put;
+	}
+
+	/* Only a hint for readahead, the load works without it. */
+	vfs_fadvise(file, load->file_offset, file_size, POSIX_FADV_SEQUENTIAL);
+
+	start = ktime_get_ns();
+	err = rt_load_read(file, dst, file_size, load->file_offset);
+	if (err)
+		goto out_unmap;
+	memset(dst + file_size, 0, mem_size - file_size);
+	load->nsec = ktime_get_ns() - start;
+
+	load->bytes = file_size;
+	load->entry_phys = region.start + load->entry;
+	pr_info(
+		"jailhouse: RTOS image loaded, %llu bytes in %llu us (%llu MB/s), "
+		"entry at 0x%llx\n",
+		file_size, div_u64(load->nsec, NSEC_PER_USEC),
+		div64_u64(file_size * NSEC_PER_SEC / SZ_1M, load->nsec ?: 1),
+		load->entry_phys);
+
+out_unmap:
+	jailhouse_rt_memunmap(dst);
+out_put:
+	fput(file);
+	return err;
+}
@@ -0,0 +1,8 @@
+#ifndef _JAILHOUSE_RT_LOAD_H
+#define _JAILHOUSE_RT_LOAD_H
+
+#include "jailhouse.h"
+
+int jailhouse_rt_load(struct jailhouse_load_rt *load);
+
+#endif /* !_JAILHOUSE_RT_LOAD_H */
@@ -0,0 +1,278 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Mapping of the RTOS memory region into userspace through /dev/jailhouse.
+ * File offset 0 is the start of rt_region. Faults are served with PUD or
+ * PMD entries where the VMA covers the whole huge page and the physical
+ * address is aligned for it, with PTEs otherwise. So rt_region should be
+ * aligned to the page size in question (see `jailhouse enable --huge`).
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#include <linux/err.h>
+#include <linux/huge_mm.h>
+#include <linux/io.h>
+#include <linux/mm.h>
+#include <linux/mman.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
+#include <linux/version.h>
+#if __has_include(<linux/pfn_t.h>)
+#include <linux/pfn_t.h>
+#endif
+
+#include "jailhouse.h"
+#include "rt-channel.h"
+#include "rt-mmap.h"
+
+int get_rt_memory_region(struct mem_region *region);
+
+/* Device inode of the mappings, to revoke them when rt_region goes away */
+static struct inode *rt_inode;
+/* Kernel mappings from jailhouse_rt_memremap() */
+static unsigned int rt_kernel_maps;
+/* Orders rt_region lookups of faults and kernel mappings against its
+ * teardown in jailhouse_rt_mmap_revoke(), protects the above */
+static DEFINE_MUTEX(rt_lock);
+
+#ifdef PFN_DEV
+#define rt_pfn(pfn) __pfn_to_pfn_t(pfn, PFN_DEV)
+#else
+#define rt_pfn(pfn) (pfn)
+#endif
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 10, 0)
+#define rt_default_unmapped_area(file, addr, len, pgoff, flags)                \
+	mm_get_unmapped_area(current->mm, file, addr, len, pgoff, flags)
+#else
+#define rt_default_unmapped_area(file, addr, len, pgoff, flags)                \
+	current->mm->get_unmapped_area(file, addr, len, pgoff, flags)
+#endif
+
+/* Physical address backing a virtual address of a VMA */
+static phys_addr_t rt_phys(struct vm_area_struct *vma, unsigned long addr)
+{
+	return (phys_addr_t)(unsigned long)vma->vm_private_data +
+		   (addr - vma->vm_start);
+}
+
+static vm_fault_t rt_insert(
+	struct vm_fault *vmf, phys_addr_t phys, unsigned long addr,
+	unsigned long size)
+{
+	if (size == PAGE_SIZE)
+		return vmf_insert_pfn(vmf->vma, addr, PHYS_PFN(phys));
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	if (size == PMD_SIZE)
+		return vmf_insert_pfn_pmd(
+			vmf, rt_pfn(PHYS_PFN(phys)), vmf->flags & FAULT_FLAG_WRITE);
+#endif
+#ifdef CONFIG_HAVE_ARCH_TRANSPARENT_HUGEPAGE_PUD
+	if (size == PUD_SIZE)
+		return vmf_insert_pfn_pud(
+			vmf, rt_pfn(PHYS_PFN(phys)), vmf->flags & FAULT_FLAG_WRITE);
+#endif
+	return VM_FAULT_FALLBACK;
+}
+
+static vm_fault_t rt_fault_size(struct vm_fault *vmf, unsigned long size)
+{
+	struct vm_area_struct *vma = vmf->vma;
+	unsigned long addr = vmf->address & ~(size - 1);
+	struct mem_region region;
+	phys_addr_t phys;
+	vm_fault_t ret;
+
+	if (addr < vma->vm_start || addr + size > vma->vm_end)
+		return VM_FAULT_FALLBACK;
+	phys = rt_phys(vma, addr);
+	if (!IS_ALIGNED(phys, size))
+		return VM_FAULT_FALLBACK;
+
+	/* rt_region may have been freed since the mapping was made, it must
+	 * not go away before the entry is in place for the revoke to zap it */
+	mutex_lock(&rt_lock);
+	if (get_rt_memory_region(&region) || phys < region.start ||
+		phys + size > region.start + region.size)
+		ret = VM_FAULT_SIGBUS;
+	else
+		ret = rt_insert(vmf, phys, addr, size);
+	mutex_unlock(&rt_lock);
+	return ret;
+}
+
+static vm_fault_t rt_fault(struct vm_fault *vmf)
+{
+	return rt_fault_size(vmf, PAGE_SIZE);
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 6, 0)
+static vm_fault_t rt_huge_fault(struct vm_fault *vmf, unsigned int order)
+{
+	return rt_fault_size(vmf, PAGE_SIZE << order);
+}
+#else
+static vm_fault_t rt_huge_fault(struct vm_fault *vmf, enum page_entry_size pe)
+{
+	switch (pe)
+	{
+	case PE_SIZE_PMD:
+		return rt_fault_size(vmf, PMD_SIZE);
+	case PE_SIZE_PUD:
+		return rt_fault_size(vmf, PUD_SIZE);
+	default:
+		return rt_fault_size(vmf, PAGE_SIZE);
+	}
+}
+#endif
+
+static const struct vm_operations_struct rt_vm_ops = {
+	.fault = rt_fault,
+	.huge_fault = rt_huge_fault,
+};
+
+int jailhouse_rt_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	unsigned long size = vma->vm_end - vma->vm_start;
+	struct mem_region region;
+	unsigned long long offset;
+
+	if (get_rt_memory_region(&region))
+		return -ENODEV;
+	/* private mappings would need struct pages to copy on write */
+	if (!(vma->vm_flags & VM_SHARED))
+		return -EINVAL;
+
+	offset = (unsigned long long)vma->vm_pgoff << PAGE_SHIFT;
+	if (offset >= region.size || size > region.size - offset)
+		return -EINVAL;
+
+	vma->vm_private_data = (void *)(unsigned long)(region.start + offset);
+	vma->vm_ops = &rt_vm_ops;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+	vm_flags_set(vma, VM_PFNMAP | VM_HUGEPAGE | VM_DONTEXPAND | VM_DONTDUMP);
+#else
+	vma->vm_flags |= VM_PFNMAP | VM_HUGEPAGE | VM_DONTEXPAND | VM_DONTDUMP;
+#endif
+
+	mutex_lock(&rt_lock);
+	if (rt_inode != file_inode(file))
+	{
+		iput(rt_inode);
+		rt_inode = file_inode(file);
+		ihold(rt_inode);
+	}
+	mutex_unlock(&rt_lock);
+
+	return 0;
+}
+
+/*
+ * Place mappings so that their addresses agree with the file offset modulo
+ * the largest page size fitting into them. The core mm only lets the huge
+ * fault handler map a page size that is aligned like that.
+ */
+unsigned long jailhouse_rt_get_unmapped_area(
+	struct file *file, unsigned long addr, unsigned long len,
+	unsigned long pgoff, unsigned long flags)
+{
+	unsigned long align, area, offset;
+
+	if (len >= PUD_SIZE)
+		align = PUD_SIZE;
+	else if (len >= PMD_SIZE)
+		align = PMD_SIZE;
+	else
+		align = PAGE_SIZE;
+
+	if (addr || (flags & MAP_FIXED) || align == PAGE_SIZE ||
+		len + align < len)
+		return rt_default_unmapped_area(file, addr, len, pgoff, flags);
+
+	area = rt_default_unmapped_area(file, 0, len + align, pgoff, flags);
+	if (IS_ERR_VALUE(area))
+		return rt_default_unmapped_area(file, addr, len, pgoff, flags);
+
+	offset = pgoff << PAGE_SHIFT;
+	return area + ((offset - area) & (align - 1));
+}
+
+/**
+ * Map part of rt_region into the kernel, e.g. to reach channels of
+ * rt-channel.h. rt_region cannot be freed until the mapping is released
+ * with jailhouse_rt_memunmap().
+ * @param offset	Offset into rt_region.
+ * @param size		Size of the part.
+ *
+ * @return Mapping, NULL if rt_region is not known or too small.
+ */
+void *jailhouse_rt_memremap(unsigned long long offset, unsigned long size)
+{
+	struct mem_region region;
+
+	return jailhouse_rt_memremap_region(offset, size, &region);
+}
+EXPORT_SYMBOL(jailhouse_rt_memremap);
+
+/**
+ * Like jailhouse_rt_memremap(), and return the rt_region looked up for the
+ * mapping in @c region, size 0 if it is not known.
+ */
+void *jailhouse_rt_memremap_region(
+	unsigned long long offset, unsigned long size, struct mem_region *region)
+{
+	void *addr = NULL;
+
+	mutex_lock(&rt_lock);
+	if (get_rt_memory_region(region))
+		region->start = region->size = 0;
+	else if (offset < region->size && size <= region->size - offset)
+		addr = memremap(region->start + offset, size, MEMREMAP_WB);
+	if (addr)
+		rt_kernel_maps++;
+	mutex_unlock(&rt_lock);
+	return addr;
+}
+
+void jailhouse_rt_memunmap(void *addr)
+{
+	memunmap(addr);
+	mutex_lock(&rt_lock);
+	rt_kernel_maps--;
+	mutex_unlock(&rt_lock);
+}
+EXPORT_SYMBOL(jailhouse_rt_memunmap);
+
+/**
+ * Zap all userspace mappings of rt_region before its memory is freed.
+ * Accesses through them fault and get SIGBUS once rt_region is gone.
+ * @param region	rt_region, cleared under the same lock as faults look
+ *			it up. NULL to only zap the mappings.
+ *
+ * @return 0 on success, -EBUSY if the kernel still maps rt_region; it is
+ * left alone then.
+ */
+int jailhouse_rt_mmap_revoke(struct mem_region *region)
+{
+	int err = 0;
+
+	mutex_lock(&rt_lock);
+	if (region && rt_kernel_maps)
+		err = -EBUSY;
+	else
+	{
+		if (region)
+			region->start = region->size = 0;
+		if (rt_inode)
+		{
+			unmap_mapping_range(rt_inode->i_mapping, 0, 0, 1);
+			iput(rt_inode);
+			rt_inode = NULL;
+		}
+	}
+	mutex_unlock(&rt_lock);
+	return err;
+}
@@ -0,0 +1,17 @@
+#ifndef _JAILHOUSE_RT_MMAP_H
+#define _JAILHOUSE_RT_MMAP_H
+
+#include <linux/fs.h>
+#include <linux/mm_types.h>
+
+#include "jailhouse.h"
+
+int jailhouse_rt_mmap(struct file *file, struct vm_area_struct *vma);
+unsigned long jailhouse_rt_get_unmapped_area(
+	struct file *file, unsigned long addr, unsigned long len,
+	unsigned long pgoff, unsigned long flags);
+void *jailhouse_rt_memremap_region(
+	unsigned long long offset, unsigned long size, struct mem_region *region);
+int jailhouse_rt_mmap_revoke(struct mem_region *region);
+
+#endif /* !_JAILHOUSE_RT_MMAP_H */
@@ -0,0 +1,283 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Attributes under /sys/devices/jailhouse.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#include <linux/device.h>
+#include <linux/kernel.h>
+#include <linux/kobject.h>
+#include <linux/rwsem.h>
+#include <linux/slab.h>
+#include <linux/sysfs.h>
+
+#include "ioremap.h"
+#include "sysfs.h"
+
+/* mapping/: page table entries used to map the hypervisor memory */
+
+static ssize_t
+pud_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	return sysfs_emit(buf, "%lu\n", jailhouse_map_stats.pud);
+}
+
+static ssize_t
+pmd_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	return sysfs_emit(buf, "%lu\n", jailhouse_map_stats.pmd);
+}
+
+static ssize_t
+pte_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	return sysfs_emit(buf, "%lu\n", jailhouse_map_stats.pte);
+}
+
+static DEVICE_ATTR_RO(pud);
+static DEVICE_ATTR_RO(pmd);
+static DEVICE_ATTR_RO(pte);
+
+static struct attribute *mapping_attrs[] = {
+	&dev_attr_pud.attr,
+	&dev_attr_pmd.attr,
+	&dev_attr_pte.attr,
+	NULL,
+};
+
+static const struct attribute_group mapping_group = {
+	.name = "mapping",
+	.attrs = mapping_attrs,
+};
+
+/*
+ * stats/: counters of the running hypervisor, summed up over all CPUs, and
+ * per CPU in stats/cpuN/. They are read from the hypervisor memory without
+ * issuing hypercalls. Reads fail with EAGAIN if a CPU is in the middle of
+ * an update for too long.
+ */
+
+/* An update in progress takes a few instructions, give up on a stuck one. */
+#define STATS_READ_RETRIES 1000
+
+/* Held for writing while the statistics area appears or goes away */
+static DECLARE_RWSEM(stats_sem);
+static const struct jailhouse_cpu_stats *stats_area;
+static unsigned int stats_cpus;
+
+static struct kobject *stats_kobj;
+static struct kobject **stats_cpu_kobjs;
+
+struct stats_attribute
+{
+	struct kobj_attribute attr;
+	/* sum of @count counters starting at @offset */
+	unsigned int offset;
+	unsigned int count;
+};
+
+/* Add a consistent snapshot of the counters to @c sum, or fail. */
+static int stats_read(
+	const struct jailhouse_cpu_stats *stats, const struct stats_attribute *sa,
+	u64 *sum)
+{
+	const u64 *counters = (const void *)stats + sa->offset;
+	unsigned int retries = STATS_READ_RETRIES, n;
+	u64 seq, snapshot;
+
+	do
+	{
+		seq = READ_ONCE(stats->seq);
+		smp_rmb();
+		for (snapshot = 0, n = 0; n < sa->count; n++)
+			snapshot += READ_ONCE(counters[n]);
+		smp_rmb();
+		if (!(seq & 1) && seq == READ_ONCE(stats->seq))
+		{
+			*sum += snapshot;
+			return 0;
+		}
+	} while (--retries);
+
+	return -EAGAIN;
+}
+
+static ssize_t
+stats_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+	const struct stats_attribute *sa =
+		container_of(attr, struct stats_attribute, attr);
+	unsigned int cpu;
+	ssize_t ret;
+	u64 sum = 0;
+
+	down_read(&stats_sem);
+	ret = -ENODEV;
+	if (!stats_area)
+		goto out;
+
+	if (kobj == stats_kobj)
+	{
+		for (cpu = 0; cpu < stats_cpus; cpu++)
+		{
+			ret = stats_read(&stats_area[cpu], sa, &sum);
+			if (ret)
+				goto out;
+		}
+	}
+	else
+	{
+		/* stats/cpuN */
+		if (kstrtouint(kobject_name(kobj) + 3, 10, &cpu) ||
+			cpu >= stats_cpus)
+			goto out;
+		ret = stats_read(&stats_area[cpu], sa, &sum);
+		if (ret)
+			goto out;
+	}
+	ret = sysfs_emit(buf, "%llu\n", sum);
+
+out:
+	up_read(&stats_sem);
+	return ret;
+}
+
+#define STATS_ATTR(_name, _field, _count)                                      \
+	static struct stats_attribute stats_attr_##_name = {                       \
+		.attr = __ATTR(_name, 0444, stats_show, NULL),                         \
+		.offset = offsetof(struct jailhouse_cpu_stats, _field),                \
+		.count = _count,                                                       \
+	}
+
+#define STATS_EXIT_ATTR(_name, _reason)                                        \
+	STATS_ATTR(exits_##_name, exits[JAILHOUSE_EXIT_##_reason], 1)
+
+STATS_ATTR(exits, exits, JAILHOUSE_NUM_EXIT_REASONS);
+STATS_EXIT_ATTR(hypercall, HYPERCALL);
+STATS_EXIT_ATTR(mmio, MMIO);
+STATS_EXIT_ATTR(pio, PIO);
+STATS_EXIT_ATTR(msr, MSR);
+STATS_EXIT_ATTR(cpuid, CPUID);
+STATS_EXIT_ATTR(xsetbv, XSETBV);
+STATS_EXIT_ATTR(cr, CR);
+STATS_EXIT_ATTR(exception, EXCEPTION);
+STATS_EXIT_ATTR(interrupt, INTERRUPT);
+STATS_EXIT_ATTR(management, MANAGEMENT);
+STATS_EXIT_ATTR(other, OTHER);
+STATS_ATTR(hv_cycles, hv_cycles, 1);
+STATS_ATTR(irqs_injected, irqs_injected, 1);
+
+static struct attribute *stats_attrs[] = {
+	&stats_attr_exits.attr.attr,
+	&stats_attr_exits_hypercall.attr.attr,
+	&stats_attr_exits_mmio.attr.attr,
+	&stats_attr_exits_pio.attr.attr,
+	&stats_attr_exits_msr.attr.attr,
+	&stats_attr_exits_cpuid.attr.attr,
+	&stats_attr_exits_xsetbv.attr.attr,
+	&stats_attr_exits_cr.attr.attr,
+	&stats_attr_exits_exception.attr.attr,
+	&stats_attr_exits_interrupt.attr.attr,
+	&stats_attr_exits_management.attr.attr,
+	&stats_attr_exits_other.attr.attr,
+	&stats_attr_hv_cycles.attr.attr,
+	&stats_attr_irqs_injected.attr.attr,
+	NULL,
+};
+
+static const struct attribute_group stats_group = {
+	.attrs = stats_attrs,
+};
+
+/* Publish the statistics area of the hypervisor that was just entered. */
+void jailhouse_sysfs_stats_start(
+	const struct jailhouse_cpu_stats *stats, unsigned int num_cpus)
+{
+	down_write(&stats_sem);
+	stats_area = stats;
+	stats_cpus = num_cpus;
+	up_write(&stats_sem);
+}
+
+void jailhouse_sysfs_stats_stop(void)
+{
+	down_write(&stats_sem);
+	stats_area = NULL;
+	up_write(&stats_sem);
+}
+
+static void stats_remove(void)
+{
+	unsigned int cpu;
+
+	if (stats_cpu_kobjs)
+		for (cpu = 0; cpu < nr_cpu_ids; cpu++)
+			kobject_put(stats_cpu_kobjs[cpu]);
+	kfree(stats_cpu_kobjs);
+	stats_cpu_kobjs = NULL;
+	kobject_put(stats_kobj);
+	stats_kobj = NULL;
+}
+
+static int stats_create(struct device *dev)
+{
+	char name[16];
+	unsigned int cpu;
+	int err;
+
+	stats_kobj = kobject_create_and_add("stats", &dev->kobj);
+	if (!stats_kobj)
+		return -ENOMEM;
+	err = sysfs_create_group(stats_kobj, &stats_group);
+	if (err)
+		goto error;
+
+	stats_cpu_kobjs =
+		kcalloc(nr_cpu_ids, sizeof(*stats_cpu_kobjs), GFP_KERNEL);
+	if (!stats_cpu_kobjs)
+	{
+		err = -ENOMEM;
+		goto error;
+	}
+	for_each_possible_cpu(cpu)
+	{
+		snprintf(name, sizeof(name), "cpu%u", cpu);
+		stats_cpu_kobjs[cpu] = kobject_create_and_add(name, stats_kobj);
+		if (!stats_cpu_kobjs[cpu])
+		{
+			err = -ENOMEM;
+			goto error;
+		}
+		err = sysfs_create_group(stats_cpu_kobjs[cpu], &stats_group);
+		if (err)
+			goto error;
+	}
+	return 0;
+
+error:
+	stats_remove();
+	return err;
+}
+
+int jailhouse_sysfs_init(struct device *dev)
+{
+	int err;
+
+	err = sysfs_create_group(&dev->kobj, &mapping_group);
+	if (err)
+		return err;
+
+	err = stats_create(dev);
+	if (err)
+		sysfs_remove_group(&dev->kobj, &mapping_group);
+	return err;
+}
+
+void jailhouse_sysfs_exit(struct device *dev)
+{
+	stats_remove();
+	sysfs_remove_group(&dev->kobj, &mapping_group);
+}
@@ -0,0 +1,15 @@
+#ifndef _JAILHOUSE_SYSFS_H
+#define _JAILHOUSE_SYSFS_H
+
+#include <linux/device.h>
+
+#include "jailhouse.h"
+
+int jailhouse_sysfs_init(struct device *dev);
+void jailhouse_sysfs_exit(struct device *dev);
+
+void jailhouse_sysfs_stats_start(
+	const struct jailhouse_cpu_stats *stats, unsigned int num_cpus);
+void jailhouse_sysfs_stats_stop(void);
+
+#endif /* !_JAILHOUSE_SYSFS_H */
@@ -0,0 +1,117 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Tracepoints of the enable/disable path. Use `jailhouse trace` or the
+ * events/jailhouse/ directory of tracefs to record them.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#ifndef _JAILHOUSE_TRACE_PHASES_H
+#define _JAILHOUSE_TRACE_PHASES_H
+
+/* enum jailhouse_phase */
+#include "jailhouse.h"
+
+#endif /* !_JAILHOUSE_TRACE_PHASES_H */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM jailhouse
+
+#if !defined(_JAILHOUSE_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _JAILHOUSE_TRACE_H
+
+#include <linux/tracepoint.h>
+
+TRACE_DEFINE_ENUM(JAILHOUSE_PHASE_ENABLE);
+TRACE_DEFINE_ENUM(JAILHOUSE_PHASE_FW_LOAD);
+TRACE_DEFINE_ENUM(JAILHOUSE_PHASE_MEM_REGIONS);
+TRACE_DEFINE_ENUM(JAILHOUSE_PHASE_IOREMAP);
+TRACE_DEFINE_ENUM(JAILHOUSE_PHASE_COPY);
+TRACE_DEFINE_ENUM(JAILHOUSE_PHASE_CONFIG);
+TRACE_DEFINE_ENUM(JAILHOUSE_PHASE_FLUSH_ICACHE);
+TRACE_DEFINE_ENUM(JAILHOUSE_PHASE_ENTER);
+TRACE_DEFINE_ENUM(JAILHOUSE_PHASE_DISABLE);
+TRACE_DEFINE_ENUM(JAILHOUSE_PHASE_LEAVE);
+
+#define show_jailhouse_phase(phase)                                            \
+	__print_symbolic(                                                          \
+		phase, {JAILHOUSE_PHASE_ENABLE, "enable"},                             \
+		{JAILHOUSE_PHASE_FW_LOAD, "fw_load"},                                  \
+		{JAILHOUSE_PHASE_MEM_REGIONS, "mem_regions"},                          \
+		{JAILHOUSE_PHASE_IOREMAP, "ioremap"},                                  \
+		{JAILHOUSE_PHASE_COPY, "copy"}, {JAILHOUSE_PHASE_CONFIG, "config"},    \
+		{JAILHOUSE_PHASE_FLUSH_ICACHE, "flush_icache"},                        \
+		{JAILHOUSE_PHASE_ENTER, "enter"},                                      \
+		{JAILHOUSE_PHASE_DISABLE, "disable"},                                  \
+		{JAILHOUSE_PHASE_LEAVE, "leave"})
+
+TRACE_EVENT(
+	jailhouse_phase_begin,
+
+	TP_PROTO(unsigned int phase),
+
+	TP_ARGS(phase),
+
+	TP_STRUCT__entry(__field(unsigned int, phase)),
+
+	TP_fast_assign(__entry->phase = phase;),
+
+	TP_printk("phase=%s", show_jailhouse_phase(__entry->phase)));
+
+TRACE_EVENT(
+	jailhouse_phase_end,
+
+	TP_PROTO(unsigned int phase, int err),
+
+	TP_ARGS(phase, err),
+
+	TP_STRUCT__entry(__field(unsigned int, phase) __field(int, err)),
+
+	TP_fast_assign(__entry->phase = phase; __entry->err = err;),
+
+	TP_printk(
+		"phase=%s err=%d", show_jailhouse_phase(__entry->phase),
+		__entry->err));
+
+/* Emitted on each CPU around its entry into or exit from the hypervisor.
+ * @op is JAILHOUSE_PHASE_ENTER or JAILHOUSE_PHASE_LEAVE. */
+TRACE_EVENT(
+	jailhouse_cpu_begin,
+
+	TP_PROTO(unsigned int cpu, unsigned int op),
+
+	TP_ARGS(cpu, op),
+
+	TP_STRUCT__entry(__field(unsigned int, cpu) __field(unsigned int, op)),
+
+	TP_fast_assign(__entry->cpu = cpu; __entry->op = op;),
+
+	TP_printk("cpu=%u op=%s", __entry->cpu, show_jailhouse_phase(__entry->op)));
+
+TRACE_EVENT(
+	jailhouse_cpu_end,
+
+	TP_PROTO(unsigned int cpu, unsigned int op, int err),
+
+	TP_ARGS(cpu, op, err),
+
+	TP_STRUCT__entry(
+		__field(unsigned int, cpu) __field(unsigned int, op) __field(int, err)),
+
+	TP_fast_assign(__entry->cpu = cpu; __entry->op = op; __entry->err = err;),
+
+	TP_printk(
+		"cpu=%u op=%s err=%d", __entry->cpu, show_jailhouse_phase(__entry->op),
+		__entry->err));
+
+#endif /* !_JAILHOUSE_TRACE_H || TRACE_HEADER_MULTI_READ */
+
+/* The module is built out of tree, so point define_trace.h at this file. */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE trace
+
+#include <trace/define_trace.h>
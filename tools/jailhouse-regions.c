@@ -0,0 +1,560 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Test and benchmark of the root cell region builder on real or synthetic
+ * /proc/iomem dumps. Builds driver/regions.c as used by the module.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#include <errno.h>
+#include <libgen.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* kbuild defines __KERNEL__ for tools too */
+#ifndef JAILHOUSE_USERSPACE
+#define JAILHOUSE_USERSPACE
+#endif
+#include "regions.c"
+
+#define IOMEM_LINE_MAX 256
+#define DEFAULT_ITERATIONS 10
+
+struct iomem_map
+{
+	struct jailhouse_iomem_entry *entries;
+	int num;
+	int capacity;
+};
+
+struct bench_result
+{
+	struct jailhouse_layout_stats stats;
+	int num_regions;
+	unsigned long config_size;
+	unsigned long long min_ns;
+	unsigned long long total_ns;
+};
+
+static void __attribute__((noreturn)) help(char *prog, int exit_status)
+{
+	printf(
+		"Usage: %s { FILE | --generate N } [OPTIONS]\n"
+		"\nBuild the root cell configuration from a /proc/iomem dump (\"-\" "
+		"for stdin)\nor from N generated entries, check it and time the "
+		"generation.\n"
+		"\nOptions:\n"
+		"   --seed S             seed of --generate (default 1)\n"
+		"   --reserve START:SIZE hypervisor memory (default: largest "
+		"\"Reserved\" entry)\n"
+		"   --iterations N       timed runs (default %d)\n"
+		"   --no-optimize        skip the layout optimizer\n"
+		"   --cpus N             describe N CPUs (default 0) ...\n"
+		"   --nodes N            ... spread over N NUMA nodes (default 1)\n"
+		"   --max-size BYTES     fail if the config gets larger\n"
+		"   --max-usec USEC      fail if the fastest run is slower\n",
+		basename(prog), DEFAULT_ITERATIONS);
+	exit(exit_status);
+}
+
+static unsigned long long parse_number(const char *prog, const char *arg)
+{
+	unsigned long long value;
+	char *end;
+
+	errno = 0;
+	value = strtoull(arg, &end, 0);
+	if (errno || end == arg || *end)
+	{
+		fprintf(stderr, "invalid number: %s\n", arg);
+		help((char *)prog, 1);
+	}
+	return value;
+}
+
+static struct jailhouse_iomem_entry *iomem_add(struct iomem_map *map)
+{
+	struct jailhouse_iomem_entry *entries;
+
+	if (map->num == map->capacity)
+	{
+		map->capacity = map->capacity ? map->capacity * 2 : 1024;
+		entries = realloc(map->entries, map->capacity * sizeof(*entries));
+		if (!entries)
+		{
+			perror("realloc");
+			exit(1);
+		}
+		map->entries = entries;
+	}
+	return &map->entries[map->num++];
+}
+
+/*
+ * Read the top-level entries of a /proc/iomem dump, nested ones are
+ * indented and not looked at by the driver either.
+ */
+static int iomem_read(const char *path, struct iomem_map *map)
+{
+	struct jailhouse_iomem_entry *entry;
+	unsigned long long start, end;
+	char line[IOMEM_LINE_MAX];
+	bool all_zero = true;
+	int name_pos;
+	FILE *file;
+	char *nl;
+
+	file = strcmp(path, "-") ? fopen(path, "r") : stdin;
+	if (!file)
+	{
+		perror(path);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), file))
+	{
+		if (line[0] == ' ' || line[0] == '\n')
+			continue;
+		if (sscanf(line, "%llx-%llx : %n", &start, &end, &name_pos) != 2 ||
+			!name_pos || end < start)
+		{
+			fprintf(stderr, "%s: malformed line: %s", path, line);
+			goto error;
+		}
+		nl = strchr(line, '\n');
+		if (nl)
+			*nl = 0;
+
+		entry = iomem_add(map);
+		entry->start = start;
+		entry->end = end;
+		entry->name = strdup(line + name_pos);
+		if (!entry->name)
+		{
+			perror("strdup");
+			goto error;
+		}
+		if (start || end)
+			all_zero = false;
+	}
+	if (ferror(file))
+	{
+		perror(path);
+		goto error;
+	}
+	if (file != stdin)
+		fclose(file);
+
+	if (map->num && all_zero)
+	{
+		fprintf(stderr, "%s: addresses are hidden, read it as root\n", path);
+		return -1;
+	}
+	return 0;
+
+error:
+	if (file != stdin)
+		fclose(file);
+	return -1;
+}
+
+static unsigned long long rand_pages(unsigned long long max_pages)
+{
+	return (1 + (unsigned long long)rand() % max_pages) * PAGE_SIZE;
+}
+
+/*
+ * Generate a fragmented map as seen on large hosts: System RAM interleaved
+ * with small reserved, ACPI and device ranges, sometimes with holes in
+ * between, and one large "Reserved" entry for the hypervisor in the middle.
+ */
+static void iomem_generate(struct iomem_map *map, int num, unsigned int seed)
+{
+	static const char *const small_kinds[] = {
+		"Reserved", "ACPI Tables", "ACPI Non-volatile Storage",
+		"PCI Bus 0000:00", "RAM buffer"};
+	struct jailhouse_iomem_entry *entry;
+	unsigned long long addr = 0;
+	int n, r;
+
+	srand(seed);
+	for (n = 0; n < num; n++)
+	{
+		entry = iomem_add(map);
+		if (n == num / 2)
+		{
+			addr = round_up(addr, SZ_1G);
+			entry->name = "Reserved";
+			entry->start = addr;
+			addr += 512ULL << 20;
+		}
+		else
+		{
+			r = rand() % 10;
+			entry->start = addr;
+			if (r < 6)
+			{
+				entry->name = "System RAM";
+				addr += rand_pages(SZ_1G / PAGE_SIZE);
+			}
+			else
+			{
+				entry->name = small_kinds[r - 6];
+				addr += rand_pages(256);
+			}
+		}
+		entry->end = addr - 1;
+		if (rand() % 8 == 0)
+			addr += rand_pages(16);
+	}
+}
+
+static const struct jailhouse_iomem_entry *
+largest_reserved(const struct iomem_map *map)
+{
+	const struct jailhouse_iomem_entry *best = NULL;
+	int n;
+
+	for (n = 0; n < map->num; n++)
+		if (!strcmp(map->entries[n].name, "Reserved") &&
+			(!best || map->entries[n].end - map->entries[n].start >
+						  best->end - best->start))
+			best = &map->entries[n];
+	return best;
+}
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Build the configuration as jailhouse_cmd_enable() does. Returns it
+ * malloc'ed, or NULL if the reserved region overlaps other memory.
+ */
+static struct jailhouse_system *build_config(
+	const struct iomem_map *map, const struct mem_region *reserved,
+	const struct jailhouse_topology *topology, bool optimize,
+	struct bench_result *res)
+{
+	struct jailhouse_memory *mem_regions, *opt_regions;
+	struct mem_region rt_region = {0, 0};
+	struct jailhouse_system *config;
+	int num;
+
+	mem_regions = malloc((map->num + 1) * sizeof(*mem_regions));
+	if (!mem_regions)
+		return NULL;
+	num = jailhouse_get_mem_regions(
+		map->entries, map->num, reserved, mem_regions);
+	if (num < 0)
+	{
+		free(mem_regions);
+		return NULL;
+	}
+	memset(&res->stats, 0, sizeof(res->stats));
+	if (optimize)
+	{
+		opt_regions = malloc(
+			num * JAILHOUSE_MEM_REGION_MAX_SPLIT * sizeof(*opt_regions));
+		if (!opt_regions)
+		{
+			free(mem_regions);
+			return NULL;
+		}
+		num = jailhouse_optimize_mem_regions(
+			mem_regions, num, opt_regions, &res->stats);
+		free(mem_regions);
+		mem_regions = opt_regions;
+	}
+
+	res->num_regions = num;
+	res->config_size = jailhouse_system_config_bytes(num, topology);
+	config = malloc(res->config_size);
+	if (config)
+		jailhouse_init_system_config(
+			config, reserved, &rt_region, num, mem_regions, topology);
+	free(mem_regions);
+	return config;
+}
+
+static bool region_covered(
+	const struct jailhouse_memory *regions, int num, unsigned long long s,
+	unsigned long long e)
+{
+	int lo = 0, hi = num;
+
+	if (s >= e)
+		return true;
+
+	/* first region ending after s */
+	while (lo < hi)
+	{
+		int mid = (lo + hi) / 2;
+
+		if (regions[mid].phys_start + regions[mid].size <= s)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for (; lo < num && s < e; lo++)
+	{
+		if (regions[lo].phys_start > s)
+			return false;
+		s = regions[lo].phys_start + regions[lo].size;
+	}
+	return s >= e;
+}
+
+/* Whether a region overlapping [s, e) allows DMA. */
+static bool region_dma(
+	const struct jailhouse_memory *regions, int num, unsigned long long s,
+	unsigned long long e)
+{
+	int n;
+
+	for (n = 0; n < num && regions[n].phys_start < e; n++)
+		if (regions[n].phys_start + regions[n].size > s &&
+			(regions[n].flags & JAILHOUSE_MEM_DMA))
+			return true;
+	return false;
+}
+
+#define check(cond, fmt, ...)                                                  \
+	do                                                                         \
+	{                                                                          \
+		if (!(cond))                                                           \
+		{                                                                      \
+			fprintf(stderr, "FAIL: " fmt "\n", ##__VA_ARGS__);                 \
+			return false;                                                      \
+		}                                                                      \
+	} while (0)
+
+static bool check_config(
+	const struct jailhouse_system *config, const struct bench_result *res,
+	const struct iomem_map *map, const struct mem_region *reserved,
+	const struct jailhouse_topology *topology)
+{
+	const __u32 *cpu_node = jailhouse_system_cpu_nodes(config);
+	const struct jailhouse_memory *regions =
+		jailhouse_cell_mem_regions(&config->root_cell);
+	unsigned long long s, e, res_end = reserved->start + reserved->size;
+	int num = config->root_cell.num_memory_regions;
+	const struct jailhouse_memory *r;
+	int n;
+
+	check(!memcmp(
+			  config->signature, JAILHOUSE_SYSTEM_SIGNATURE,
+			  sizeof(config->signature)),
+		  "bad system signature");
+	check(num == res->num_regions, "%d regions in config, %d built", num,
+		  res->num_regions);
+	check(jailhouse_system_config_size((struct jailhouse_system *)config) ==
+			  res->config_size,
+		  "config size %u, expected %lu",
+		  jailhouse_system_config_size((struct jailhouse_system *)config),
+		  res->config_size);
+	check(config->num_numa_nodes == topology->num_nodes &&
+			  config->num_cpus == topology->num_cpus,
+		  "%u nodes and %u CPUs in config, %u and %u expected",
+		  config->num_numa_nodes, config->num_cpus, topology->num_nodes,
+		  topology->num_cpus);
+	for (n = 0; n < (int)topology->num_cpus; n++)
+		check(cpu_node[n] == topology->cpu_node[n],
+			  "CPU %d on node %u, expected %u", n, cpu_node[n],
+			  topology->cpu_node[n]);
+
+	for (n = 0; n < num; n++)
+	{
+		r = &regions[n];
+		s = r->phys_start;
+		e = s + r->size;
+		check(r->size, "region %d is empty", n);
+		check(r->virt_start == s, "region %d is not identity mapped", n);
+		check(!(s % PAGE_SIZE) && !(r->size % PAGE_SIZE),
+			  "region %d [0x%llx-0x%llx) is not page aligned", n, s, e);
+		check(!n || regions[n - 1].phys_start + regions[n - 1].size <= s,
+			  "region %d [0x%llx-0x%llx) overlaps or precedes its "
+			  "predecessor", n, s, e);
+		check(e <= reserved->start || res_end <= s,
+			  "region %d [0x%llx-0x%llx) overlaps the hypervisor", n, s, e);
+		if (r->flags & JAILHOUSE_MEM_HINT_1G)
+			check(!(s % SZ_1G) && !(r->size % SZ_1G) &&
+					  !(r->flags & JAILHOUSE_MEM_NO_HUGEPAGES),
+				  "region %d [0x%llx-0x%llx) has a wrong 1G hint", n, s, e);
+		if (r->flags & JAILHOUSE_MEM_HINT_2M)
+			check(!(s % SZ_2M) && !(r->size % SZ_2M) &&
+					  !(r->flags & JAILHOUSE_MEM_NO_HUGEPAGES),
+				  "region %d [0x%llx-0x%llx) has a wrong 2M hint", n, s, e);
+	}
+
+	for (n = 0; n < map->num; n++)
+	{
+		s = map->entries[n].start;
+		e = map->entries[n].end + 1;
+		check(region_covered(regions, num, s, min(e, reserved->start)) &&
+				  region_covered(regions, num, max(s, res_end), e),
+			  "%s [0x%llx-0x%llx) is not covered", map->entries[n].name, s,
+			  e);
+		if (strcmp(map->entries[n].name, "System RAM") &&
+			strcmp(map->entries[n].name, "RAM buffer"))
+			check(!region_dma(regions, num, s, e),
+				  "%s [0x%llx-0x%llx) allows DMA", map->entries[n].name, s,
+				  e);
+	}
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long long max_size = 0, max_usec = 0, start;
+	struct iomem_map map = {NULL, 0, 0};
+	const struct jailhouse_iomem_entry *entry;
+	struct jailhouse_system *config = NULL;
+	struct mem_region reserved = {0, 0};
+	struct jailhouse_topology topology;
+	struct jailhouse_numa_node *nodes;
+	unsigned int num_cpus = 0, num_nodes = 1;
+	__u32 *cpu_node;
+	const char *path = NULL;
+	int iterations = DEFAULT_ITERATIONS, generate = 0, n;
+	unsigned int seed = 1;
+	bool optimize = true, ok;
+	struct bench_result res;
+	char *sep;
+
+	for (n = 1; n < argc; n++)
+	{
+		if (!strcmp(argv[n], "--help"))
+			help(argv[0], 0);
+		else if (!strcmp(argv[n], "--generate") && n + 1 < argc)
+			generate = parse_number(argv[0], argv[++n]);
+		else if (!strcmp(argv[n], "--seed") && n + 1 < argc)
+			seed = parse_number(argv[0], argv[++n]);
+		else if (!strcmp(argv[n], "--iterations") && n + 1 < argc)
+			iterations = parse_number(argv[0], argv[++n]);
+		else if (!strcmp(argv[n], "--max-size") && n + 1 < argc)
+			max_size = parse_number(argv[0], argv[++n]);
+		else if (!strcmp(argv[n], "--max-usec") && n + 1 < argc)
+			max_usec = parse_number(argv[0], argv[++n]);
+		else if (!strcmp(argv[n], "--no-optimize"))
+			optimize = false;
+		else if (!strcmp(argv[n], "--cpus") && n + 1 < argc)
+			num_cpus = parse_number(argv[0], argv[++n]);
+		else if (!strcmp(argv[n], "--nodes") && n + 1 < argc)
+			num_nodes = parse_number(argv[0], argv[++n]);
+		else if (!strcmp(argv[n], "--reserve") && n + 1 < argc)
+		{
+			sep = strchr(argv[++n], ':');
+			if (!sep)
+				help(argv[0], 1);
+			*sep = 0;
+			reserved.start = parse_number(argv[0], argv[n]);
+			reserved.size = parse_number(argv[0], sep + 1);
+		}
+		else if (argv[n][0] != '-' || !strcmp(argv[n], "-"))
+			path = argv[n];
+		else
+			help(argv[0], 1);
+	}
+	if (!path == !generate || iterations < 1 || !num_nodes)
+		help(argv[0], 1);
+
+	/* consecutive CPUs share a node, as usually enumerated */
+	nodes = calloc(num_nodes, sizeof(*nodes));
+	cpu_node = calloc(num_cpus + 1, sizeof(*cpu_node));
+	if (!nodes || !cpu_node)
+	{
+		perror("calloc");
+		return 1;
+	}
+	for (n = 0; n < (int)num_cpus; n++)
+		cpu_node[n] = (unsigned long long)n * num_nodes / num_cpus;
+	topology.num_nodes = num_cpus ? num_nodes : 0;
+	topology.num_cpus = num_cpus;
+	topology.nodes = nodes;
+	topology.cpu_node = cpu_node;
+
+	if (generate)
+		iomem_generate(&map, generate, seed);
+	else if (iomem_read(path, &map))
+		return 1;
+
+	if (!reserved.size)
+	{
+		entry = largest_reserved(&map);
+		if (!entry)
+		{
+			fprintf(stderr, "no \"Reserved\" entry, use --reserve\n");
+			return 1;
+		}
+		reserved.start = entry->start;
+		reserved.size = entry->end - entry->start + 1;
+	}
+
+	res.min_ns = ~0ULL;
+	res.total_ns = 0;
+	for (n = 0; n < iterations; n++)
+	{
+		free(config);
+		start = now_ns();
+		config = build_config(&map, &reserved, &topology, optimize, &res);
+		start = now_ns() - start;
+		if (!config)
+		{
+			fprintf(stderr,
+					"FAIL: hypervisor memory [0x%llx-0x%llx) overlaps other "
+					"memory\n",
+					reserved.start, reserved.start + reserved.size);
+			return 1;
+		}
+		res.total_ns += start;
+		res.min_ns = min(res.min_ns, start);
+	}
+
+	printf("iomem entries:     %d\n", map.num);
+	printf("hypervisor memory: [0x%llx-0x%llx)\n", reserved.start,
+		   reserved.start + reserved.size);
+	if (optimize)
+	{
+		printf("regions:           %d -> %d (%d coalesced)\n",
+			   res.stats.regions_before, res.stats.regions_after,
+			   res.stats.regions_coalesced);
+		printf("stage-2 entries:   ~%llu -> ~%llu\n",
+			   res.stats.entries_before, res.stats.entries_after);
+	}
+	else
+		printf("regions:           %d\n", res.num_regions);
+	printf("config size:       %lu bytes\n", res.config_size);
+	printf("generation time:   min %.1f us, avg %.1f us (%d runs)\n",
+		   res.min_ns / 1000.0, res.total_ns / 1000.0 / iterations,
+		   iterations);
+
+	ok = check_config(config, &res, &map, &reserved, &topology);
+	if (max_size && res.config_size > max_size)
+	{
+		fprintf(stderr, "FAIL: config size %lu exceeds %llu bytes\n",
+				res.config_size, max_size);
+		ok = false;
+	}
+	if (max_usec && res.min_ns > max_usec * 1000)
+	{
+		fprintf(stderr, "FAIL: generation time %.1f us exceeds %llu us\n",
+				res.min_ns / 1000.0, max_usec);
+		ok = false;
+	}
+	printf("invariants:        %s\n", ok ? "ok" : "FAILED");
+
+	free(config);
+	free(cpu_node);
+	free(nodes);
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,289 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Throughput benchmark of the RT channels of rt-channel.h. A producer and a
+ * consumer thread exchange sequence numbers over one channel, either in
+ * anonymous memory or in rt_region mapped from /dev/jailhouse, so the layout
+ * can be tested without an RTOS on the other end.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <rt-channel.h>
+
+#define JAILHOUSE_DEVICE "/dev/jailhouse"
+
+struct bench_args
+{
+	struct jailhouse_rt_endpoint ep;
+	unsigned int slot_size;
+	unsigned int batch;
+	unsigned long long messages;
+	int cpu;
+	/* batch * slot_size bytes */
+	__u64 *buf;
+	/* set by the consumer */
+	unsigned long long errors;
+};
+
+static void __attribute__((noreturn)) help(char *prog, int exit_status)
+{
+	printf(
+		"Usage: %s [OPTIONS]\n"
+		"\nMeasure the throughput of an RT channel between two threads.\n"
+		"\nOptions:\n"
+		"   --device [OFFSET]  place the channel in rt_region (default: "
+		"heap)\n"
+		"   --slots N          slots of the channel, a power of two "
+		"(default 1024)\n"
+		"   --slot-size B      bytes per slot, a multiple of 8 (default "
+		"64)\n"
+		"   --batch N          slots per enqueue/dequeue (default 16)\n"
+		"   --messages M       slots to transfer (default 10000000)\n"
+		"   --cpus A,B         pin producer to A and consumer to B\n",
+		basename(prog));
+	exit(exit_status);
+}
+
+static unsigned long long parse_number(char *prog, const char *arg)
+{
+	unsigned long long value;
+	char *end;
+
+	errno = 0;
+	value = strtoull(arg, &end, 0);
+	if (errno || end == arg || *end)
+	{
+		fprintf(stderr, "invalid number: %s\n", arg);
+		help(prog, 1);
+	}
+	return value;
+}
+
+/* Failing to pin only skews the result, so just warn. */
+static void pin_thread(int cpu)
+{
+	cpu_set_t set;
+	int err;
+
+	if (cpu < 0)
+		return;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	if (err)
+		fprintf(stderr, "pinning to CPU %d: %s\n", cpu, strerror(err));
+}
+
+static void *producer(void *data)
+{
+	struct bench_args *args = data;
+	unsigned int words = args->slot_size / sizeof(__u64);
+	unsigned long long seq = 0, n;
+	struct jailhouse_rt_endpoint *ep = &args->ep;
+	unsigned int count, done;
+	__u64 *buf = args->buf;
+
+	pin_thread(args->cpu);
+
+	while (seq < args->messages)
+	{
+		count = args->batch;
+		if (count > args->messages - seq)
+			count = args->messages - seq;
+		for (n = 0; n < count; n++)
+			buf[n * words] = seq + n;
+
+		for (done = 0; done < count;)
+		{
+			n = jailhouse_rt_enqueue(
+				ep, (__u8 *)buf + (unsigned long)done * args->slot_size,
+				count - done);
+			/* let the consumer run if both share a CPU */
+			if (!n)
+				sched_yield();
+			done += n;
+		}
+		seq += count;
+	}
+	return NULL;
+}
+
+static void *consumer(void *data)
+{
+	struct bench_args *args = data;
+	unsigned int words = args->slot_size / sizeof(__u64);
+	unsigned long long seq = 0, n;
+	struct jailhouse_rt_endpoint *ep = &args->ep;
+	unsigned int count;
+	__u64 *buf = args->buf;
+
+	pin_thread(args->cpu);
+
+	while (seq < args->messages)
+	{
+		count = jailhouse_rt_dequeue(ep, buf, args->batch);
+		if (!count)
+			sched_yield();
+		for (n = 0; n < count; n++)
+			if (buf[n * words] != seq + n)
+				args->errors++;
+		seq += count;
+	}
+	return NULL;
+}
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *map_device(unsigned long long offset, unsigned long size)
+{
+	void *mem;
+	int fd;
+
+	fd = open(JAILHOUSE_DEVICE, O_RDWR);
+	if (fd < 0)
+	{
+		perror("opening " JAILHOUSE_DEVICE);
+		return NULL;
+	}
+	mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
+	close(fd);
+	if (mem == MAP_FAILED)
+	{
+		perror("mapping rt_region");
+		return NULL;
+	}
+	return mem;
+}
+
+int main(int argc, char *argv[])
+{
+	struct bench_args prod = {.cpu = -1}, cons;
+	unsigned long long offset = 0, start, elapsed;
+	unsigned int num_slots = 1024;
+	unsigned long size;
+	void *mem;
+	bool device = false;
+	pthread_t threads[2];
+	int n, err;
+
+	prod.slot_size = 64;
+	prod.batch = 16;
+	prod.messages = 10000000;
+	cons.cpu = -1;
+
+	for (n = 1; n < argc; n++)
+	{
+		if (strcmp(argv[n], "--device") == 0)
+		{
+			device = true;
+			if (n + 1 < argc && argv[n + 1][0] != '-')
+				offset = parse_number(argv[0], argv[++n]);
+		}
+		else if (strcmp(argv[n], "--slots") == 0 && n + 1 < argc)
+			num_slots = parse_number(argv[0], argv[++n]);
+		else if (strcmp(argv[n], "--slot-size") == 0 && n + 1 < argc)
+			prod.slot_size = parse_number(argv[0], argv[++n]);
+		else if (strcmp(argv[n], "--batch") == 0 && n + 1 < argc)
+			prod.batch = parse_number(argv[0], argv[++n]);
+		else if (strcmp(argv[n], "--messages") == 0 && n + 1 < argc)
+			prod.messages = parse_number(argv[0], argv[++n]);
+		else if (strcmp(argv[n], "--cpus") == 0 && n + 1 < argc)
+		{
+			if (sscanf(argv[++n], "%d,%d", &prod.cpu, &cons.cpu) != 2)
+				help(argv[0], 1);
+		}
+		else
+			help(argv[0], strcmp(argv[n], "--help") == 0 ? 0 : 1);
+	}
+	if (!prod.batch || prod.batch > num_slots)
+	{
+		fprintf(stderr, "--batch must be between 1 and --slots\n");
+		return 1;
+	}
+
+	size = jailhouse_rt_channel_size(prod.slot_size, num_slots);
+	if (device)
+		mem = map_device(offset, size);
+	else
+		mem = aligned_alloc(
+			JAILHOUSE_RT_CACHELINE, (size + JAILHOUSE_RT_CACHELINE - 1) &
+										~(JAILHOUSE_RT_CACHELINE - 1UL));
+	if (!mem)
+		return 1;
+
+	err = jailhouse_rt_channel_init(mem, size, prod.slot_size, num_slots);
+	if (!err)
+		err = jailhouse_rt_attach_producer(&prod.ep, mem, size);
+	if (!err)
+		err = jailhouse_rt_attach_consumer(&cons.ep, mem, size);
+	if (err)
+	{
+		fprintf(stderr, "invalid channel parameters: %s\n", strerror(-err));
+		return 1;
+	}
+
+	cons.slot_size = prod.slot_size;
+	cons.batch = prod.batch;
+	cons.messages = prod.messages;
+	cons.errors = 0;
+	prod.buf = calloc(prod.batch, prod.slot_size);
+	cons.buf = calloc(cons.batch, cons.slot_size);
+	if (!prod.buf || !cons.buf)
+	{
+		perror("calloc");
+		return 1;
+	}
+
+	start = now_ns();
+	err = pthread_create(&threads[1], NULL, consumer, &cons);
+	if (!err)
+	{
+		err = pthread_create(&threads[0], NULL, producer, &prod);
+		if (err)
+			pthread_cancel(threads[1]);
+		else
+			pthread_join(threads[0], NULL);
+		pthread_join(threads[1], NULL);
+	}
+	if (err)
+	{
+		fprintf(stderr, "pthread_create: %s\n", strerror(err));
+		return 1;
+	}
+	elapsed = now_ns() - start;
+
+	printf(
+		"%llu slots of %u bytes, batch %u: %.3f s, %.2f Mmsg/s, "
+		"%.1f MB/s\n",
+		prod.messages, prod.slot_size, prod.batch, elapsed / 1e9,
+		prod.messages * 1e3 / elapsed,
+		prod.messages * prod.slot_size * 1e3 / elapsed);
+	if (cons.errors)
+	{
+		fprintf(stderr, "%llu slots out of sequence\n", cons.errors);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,74 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Generator of a stand-in hypervisor image. Its entry point returns 0 and
+ * doubles as hypercall stub, so the driver and tools can be exercised on
+ * hosts without VMX or SVM:
+ *
+ *   jailhouse-standin /lib/firmware/evm-standin.bin
+ *   modprobe jailhouse fw_name=evm-standin.bin
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <jailhouse.h>
+
+#define STANDIN_CORE_SIZE 4096
+#define STANDIN_PERCPU_SIZE 64
+
+/* endbr64; xor %eax, %eax; ret */
+static const unsigned char standin_stub[] = {0xf3, 0x0f, 0x1e, 0xfa,
+											 0x31, 0xc0, 0xc3};
+
+int main(int argc, char *argv[])
+{
+	struct jailhouse_header header;
+	FILE *file;
+
+	if (argc != 2 || argv[1][0] == '-')
+	{
+		printf(
+			"Usage: %s OUTPUT\n"
+			"\nWrite a stand-in hypervisor image, load it with the "
+			"fw_name module parameter.\n",
+			basename(argv[0]));
+		return argc == 2 && strcmp(argv[1], "--help") == 0 ? 0 : 1;
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.signature, JAILHOUSE_SIGNATURE, sizeof(header.signature));
+	header.core_size = STANDIN_CORE_SIZE;
+	header.percpu_size = STANDIN_PERCPU_SIZE;
+	/* relative to the image start, the driver relocates it */
+	header.entry = (int (*)(unsigned int))(unsigned long)sizeof(header);
+	memcpy(
+		header.ext_signature, JAILHOUSE_HEADER_EXT_SIGNATURE,
+		sizeof(header.ext_signature));
+	header.revision = JAILHOUSE_HEADER_REVISION;
+	header.flags =
+		JAILHOUSE_HDR_LAZY_POOL | JAILHOUSE_HDR_REENTRANT |
+		JAILHOUSE_HDR_STANDIN | JAILHOUSE_HDR_RT_CPU_SET |
+		JAILHOUSE_HDR_NUMA_PERCPU | JAILHOUSE_HDR_CPU_HOTPLUG |
+		JAILHOUSE_HDR_MEM_BALLOON;
+
+	file = fopen(argv[1], "wb");
+	if (!file)
+	{
+		perror(argv[1]);
+		return 1;
+	}
+	if (fwrite(&header, sizeof(header), 1, file) != 1 ||
+		fwrite(standin_stub, sizeof(standin_stub), 1, file) != 1 ||
+		fclose(file) != 0)
+	{
+		perror(argv[1]);
+		return 1;
+	}
+	return 0;
+}
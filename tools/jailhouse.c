@@ -16,44 +16,912 @@
 #include <libgen.h>
 #include <limits.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <poll.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <hv-layout.h>
 #include <jailhouse.h>
+#include <regions.h>
 
 #define JAILHOUSE_DEVICE "/dev/jailhouse"
+#define TRACEFS_PATH "/sys/kernel/tracing"
+#define DEBUGFS_TRACING_PATH "/sys/kernel/debug/tracing"
 
-#define HV_PHYS_START 0x3a000000
-#define HV_MEM_SIZE (128 << 20) // 128M
-#define RT_MEM_SIZE (128 << 20) // 128M
+#define TRACE_MAX_PHASES 16
+#define TRACE_MAX_CPUS 4096
 
-static const struct jailhouse_enable_args enable_args = {
-	.hv_region =
-		{
-			.start = HV_PHYS_START,
-			.size = HV_MEM_SIZE,
-		},
-	.rt_region = {
-		.start = HV_PHYS_START + HV_MEM_SIZE,
-		.size = RT_MEM_SIZE,
-	}};
+#define BENCH_MAX_CPUS 4096
+#define BENCH_DEFAULT_ITERATIONS 10000
+#define BENCH_BAR_WIDTH 40
+
+#define RT_MAX_CPUS 4096
+#define BITS_PER_ULONG (8 * sizeof(unsigned long))
+
+/* Defaults of the layout command, also used by update-cmdline.sh */
+#define HV_DEFAULT_POOL_SIZE (32 << 20)
+#define RT_DEFAULT_SIZE (128 << 20)
+
+#define FIRMWARE_PATH "/lib/firmware"
+#define MODULE_PARAMS "/sys/module/jailhouse/parameters"
+#define CMDLINE_MAX_MEMMAP 16
+#define IOMEM_MAX_ENTRIES 1024
+/* where the layout command prefers to place the reservation */
+#define HV_PLACE_BELOW (4ULL << 30)
+
+static struct jailhouse_enable_args enable_args;
+/* Let the driver allocate the regions not given from CMA */
+static bool use_cma;
+
+/* Inputs for sizing hv_region, see hv_layout() */
+struct layout_opts
+{
+	const char *firmware;
+	/* 0 to place the reservation, see place_hv_region() */
+	unsigned long long hv_start;
+	unsigned long long rt_size;
+	unsigned long long pool_size;
+	unsigned long long align;
+};
+
+static struct layout_opts layout_opts = {
+	.rt_size = RT_DEFAULT_SIZE,
+	.pool_size = HV_DEFAULT_POOL_SIZE,
+	.align = 4096,
+};
+
+static unsigned long rt_cpu_set[RT_MAX_CPUS / BITS_PER_ULONG];
 
 static void __attribute__((noreturn)) help(char *prog, int exit_status)
 {
 	printf(
 		"Usage: %s { COMMAND | --help | --version }\n"
 		"\nAvailable commands:\n"
-		"   enable\n"
-		"   disable\n",
+		"   enable [--reload] [--async] [REGION-OPTIONS] [RT-CPU-OPTIONS]\n"
+		"   wait [--timeout SEC]\n"
+		"   disable\n"
+		"   trace [--reload] [REGION-OPTIONS] [RT-CPU-OPTIONS]\n"
+		"   bench hypercall [--iterations N]\n"
+		"   console [--follow]\n"
+		"   load-rt IMAGE [--offset OFF] [--entry OFF] [--mem-size SIZE]\n"
+		"           [--file-offset OFF]\n"
+		"   cpu assign CPU linux|rt\n"
+		"   balloon { inflate SIZE | deflate START }\n"
+		"   layout [--memmap] [LAYOUT-OPTIONS]\n"
+		"\nREGION-OPTIONS:\n"
+		"   --hv START:SIZE      hypervisor region, by default the first\n"
+		"                        memmap=SIZE$START reservation of the "
+		"kernel\n"
+		"   --rt START:SIZE      RT region, by default the second one or "
+		"the\n"
+		"                        rest of a single one\n"
+		"   --cma                allocate the regions not given from the "
+		"CMA\n"
+		"                        area instead, rt_region of --rt-size\n"
+		"   LAYOUT-OPTIONS\n"
+		"\nLAYOUT-OPTIONS:\n"
+		"   --huge 2M|1G         align regions for huge pages\n"
+		"   --firmware PATH      size for this image instead of the one the\n"
+		"                        driver loads\n"
+		"   --hv-start ADDR      start of the reservation (default: the "
+		"current\n"
+		"                        one, else the top of the highest fitting "
+		"RAM\n"
+		"                        below 4G)\n"
+		"   --rt-size SIZE       size of the RT region (default 128M)\n"
+		"   --pool-size SIZE     hypervisor page pool (default 32M)\n"
+		"\nRT-CPU-OPTIONS:\n"
+		"   --rt-cpus N          let the driver pick N RT CPUs (default 1)\n"
+		"   --rt-cpu-list LIST   use the RT CPUs in LIST, e.g. 2,4-7\n"
+		"   --isolate smt|llc    keep the SMT siblings or the last-level "
+		"cache\n"
+		"                        of the RT CPUs away from Linux, "
+		"repeatable\n",
 		basename(prog));
 	exit(exit_status);
 }
 
+static unsigned long long
+align_up(unsigned long long value, unsigned long long align)
+{
+	return (value + align - 1) / align * align;
+}
+
+/*
+ * Parse a number with an optional K, M or G suffix like the kernel's
+ * memparse(). Returns the position behind it, NULL if there is none.
+ */
+static const char *parse_size(const char *arg, unsigned long long *value)
+{
+	char *end;
+
+	errno = 0;
+	*value = strtoull(arg, &end, 0);
+	if (errno || end == arg)
+		return NULL;
+	switch (*end)
+	{
+	case 'G':
+	case 'g':
+		*value <<= 10;
+		/* fall through */
+	case 'M':
+	case 'm':
+		*value <<= 10;
+		/* fall through */
+	case 'K':
+	case 'k':
+		*value <<= 10;
+		end++;
+	}
+	return end;
+}
+
+/* Parse START:SIZE, both with optional suffixes. */
+static int parse_region(const char *arg, struct mem_region *region)
+{
+	const char *p = parse_size(arg, &region->start);
+
+	if (!p || *p != ':')
+		return -1;
+	p = parse_size(p + 1, &region->size);
+	return p && !*p && region->size ? 0 : -1;
+}
+
+/* Read the first line of a file without the newline. */
+static int read_line(const char *path, char *buf, size_t size)
+{
+	FILE *file;
+	bool ok;
+
+	file = fopen(path, "r");
+	if (!file)
+		return -1;
+	ok = fgets(buf, size, file) != NULL;
+	fclose(file);
+	if (!ok)
+		return -1;
+	buf[strcspn(buf, "\n")] = 0;
+	return 0;
+}
+
+/*
+ * Count the IDs of a sysfs list like 0-3,8 and store the highest one in
+ * *max. Returns 0 if the file is missing or malformed.
+ */
+static unsigned int count_id_list(const char *path, unsigned int *max)
+{
+	unsigned long first, last;
+	unsigned int count = 0;
+	char buf[4096], *p = buf, *end;
+
+	if (read_line(path, buf, sizeof(buf)))
+		return 0;
+	do
+	{
+		first = strtoul(p, &end, 10);
+		if (end == p)
+			return 0;
+		last = first;
+		if (*end == '-')
+		{
+			p = end + 1;
+			last = strtoul(p, &end, 10);
+			if (end == p || last < first)
+				return 0;
+		}
+		count += last - first + 1;
+		*max = last;
+		p = end + 1;
+	} while (*end == ',');
+
+	return *end ? 0 : count;
+}
+
+/* Number of top-level entries of /proc/iomem, 0 if it cannot be read. */
+static unsigned int count_iomem_entries(void)
+{
+	unsigned int num = 0;
+	bool line_start = true;
+	char line[256];
+	FILE *iomem;
+
+	iomem = fopen("/proc/iomem", "r");
+	if (!iomem)
+	{
+		perror("/proc/iomem");
+		return 0;
+	}
+	while (fgets(line, sizeof(line), iomem))
+	{
+		if (line_start && line[0] != ' ')
+			num++;
+		line_start = line[strlen(line) - 1] == '\n';
+	}
+	fclose(iomem);
+	return num;
+}
+
+/* The image the driver loads for this CPU unless fw_name is set. */
+static const char *cpu_firmware_name(void)
+{
+	const char *name = NULL;
+	char *line = NULL, *flag, *save;
+	size_t len = 0;
+	FILE *cpuinfo;
+
+	cpuinfo = fopen("/proc/cpuinfo", "r");
+	if (!cpuinfo)
+		return NULL;
+	while (getline(&line, &len, cpuinfo) > 0)
+	{
+		if (strncmp(line, "flags", 5) != 0)
+			continue;
+		for (flag = strtok_r(line, " \t\n", &save); flag;
+			 flag = strtok_r(NULL, " \t\n", &save))
+		{
+			/* the driver prefers SVM as well */
+			if (strcmp(flag, "svm") == 0)
+				name = JAILHOUSE_AMD_FW_NAME;
+			else if (strcmp(flag, "vmx") == 0 && !name)
+				name = JAILHOUSE_INTEL_FW_NAME;
+		}
+		break;
+	}
+	free(line);
+	fclose(cpuinfo);
+	return name;
+}
+
+/* Inputs and result of sizing hv_region, see hv_sizing() */
+struct hv_sizing
+{
+	char firmware[PATH_MAX];
+	struct jailhouse_header header;
+	unsigned int nodes;
+	unsigned int regions;
+	struct jailhouse_hv_layout_params params;
+	struct jailhouse_hv_layout layout;
+	unsigned long long hv_start;
+	unsigned long long hv_size;
+};
+
+/*
+ * Read the start of a zstd-compressed image with the zstd tool. Returns
+ * the bytes read, or -1 if it cannot be run on this path.
+ */
+static ssize_t read_zstd_start(const char *path, void *buf, size_t size)
+{
+	char cmd[PATH_MAX + 32];
+	size_t len;
+	FILE *pipe;
+
+	if (strchr(path, '\'') ||
+		snprintf(cmd, sizeof(cmd), "zstd -dcq -- '%s'", path) >=
+			(int)sizeof(cmd))
+		return -1;
+	pipe = popen(cmd, "r");
+	if (!pipe)
+		return -1;
+	len = fread(buf, 1, size, pipe);
+	/* zstd fails with EPIPE as the rest is not read, so ignore its status */
+	pclose(pipe);
+	return len;
+}
+
+/*
+ * Read the header of the image the driver would load: --firmware, the
+ * fw_name module parameter or the image for the CPU, in this order. Like
+ * the driver, prefer IMAGE.zst if it exists.
+ */
+static int read_firmware_header(struct hv_sizing *sizing)
+{
+	const char *name = NULL;
+	char param[NAME_MAX + 1];
+	char zstd[PATH_MAX];
+	size_t plen;
+	ssize_t len;
+	int fd;
+
+	if (layout_opts.firmware)
+		snprintf(
+			sizing->firmware, sizeof(sizing->firmware), "%s",
+			layout_opts.firmware);
+	else
+	{
+		if (read_line(MODULE_PARAMS "/fw_name", param, sizeof(param)) == 0 &&
+			param[0] && strcmp(param, "(null)") != 0)
+			name = param;
+		else
+			name = cpu_firmware_name();
+		if (!name)
+		{
+			fprintf(
+				stderr, "no VMX or SVM, select the image with --firmware\n");
+			return -1;
+		}
+		snprintf(
+			sizing->firmware, sizeof(sizing->firmware), FIRMWARE_PATH "/%s",
+			name);
+	}
+
+	plen = strlen(sizing->firmware);
+	if ((plen < 4 || strcmp(sizing->firmware + plen - 4, ".zst") != 0) &&
+		snprintf(zstd, sizeof(zstd), "%s.zst", sizing->firmware) <
+			(int)sizeof(zstd) &&
+		access(zstd, R_OK) == 0)
+		strcpy(sizing->firmware, zstd);
+
+	memset(&sizing->header, 0, sizeof(sizing->header));
+	plen = strlen(sizing->firmware);
+	if (plen >= 4 && strcmp(sizing->firmware + plen - 4, ".zst") == 0)
+	{
+		len = read_zstd_start(
+			sizing->firmware, &sizing->header, sizeof(sizing->header));
+		if (len <= 0)
+		{
+			fprintf(
+				stderr, "%s: cannot decompress, is zstd installed?\n",
+				sizing->firmware);
+			return -1;
+		}
+	}
+	else
+	{
+		fd = open(sizing->firmware, O_RDONLY);
+		if (fd < 0)
+		{
+			perror(sizing->firmware);
+			return -1;
+		}
+		len = read(fd, &sizing->header, sizeof(sizing->header));
+		close(fd);
+	}
+	if (len < (ssize_t)offsetof(struct jailhouse_header, ext_signature) ||
+		memcmp(
+			sizing->header.signature, JAILHOUSE_SIGNATURE,
+			sizeof(sizing->header.signature)) != 0)
+	{
+		fprintf(stderr, "%s: not a hypervisor image\n", sizing->firmware);
+		return -1;
+	}
+
+	/* less than the header only if the image is shorter */
+	sizing->params.features = jailhouse_header_features(&sizing->header, len);
+	sizing->params.core_size = sizing->header.core_size;
+	sizing->params.percpu_size = sizing->header.percpu_size;
+	return 0;
+}
+
+/*
+ * Compute the smallest hv_region for this host with the layout of the
+ * driver, plus the page pool of the hypervisor. The per-CPU areas are
+ * always counted, the driver falls back to placing them there.
+ */
+static int hv_sizing(struct hv_sizing *sizing)
+{
+	struct jailhouse_topology topology = {0};
+	unsigned int max_id;
+	char param[64];
+
+	memset(sizing, 0, sizeof(*sizing));
+	if (read_firmware_header(sizing))
+		return -1;
+
+	/* like num_possible_cpus() and nr_node_ids in the driver */
+	sizing->params.max_cpus =
+		count_id_list("/sys/devices/system/cpu/possible", &max_id);
+	if (!sizing->params.max_cpus)
+	{
+		fprintf(stderr, "cannot read the possible CPUs\n");
+		return -1;
+	}
+	sizing->nodes = 1;
+	if (count_id_list("/sys/devices/system/node/possible", &max_id))
+		sizing->nodes = max_id + 1;
+	sizing->regions = count_iomem_entries();
+	if (!sizing->regions)
+		return -1;
+	/* the driver's bound, with a per-CPU carve on each node */
+	sizing->regions = jailhouse_max_mem_regions(sizing->regions, sizing->nodes);
+
+	topology.num_nodes = sizing->nodes;
+	topology.num_cpus = sizing->params.max_cpus;
+	sizing->params.page_size = sysconf(_SC_PAGESIZE);
+	sizing->params.config_size =
+		jailhouse_system_config_bytes(sizing->regions, &topology);
+	sizing->params.console_size = JAILHOUSE_CONSOLE_DEFAULT_SIZE;
+	if (read_line(MODULE_PARAMS "/console_size", param, sizeof(param)) == 0)
+		sizing->params.console_size = strtoul(param, NULL, 0);
+	jailhouse_hv_layout_init(&sizing->layout, &sizing->params);
+
+	sizing->hv_size = align_up(
+		sizing->layout.end + layout_opts.pool_size, layout_opts.align);
+	return 0;
+}
+
+/*
+ * Collect the memmap=SIZE$START reservations of the kernel command line in
+ * their order. One memmap= option may list several, separated by commas.
+ */
+static int parse_memmap(struct mem_region *regions, int max)
+{
+	char cmdline[8192], *arg, *save;
+	struct mem_region region;
+	const char *p;
+	int num = 0;
+
+	if (read_line("/proc/cmdline", cmdline, sizeof(cmdline)))
+	{
+		perror("/proc/cmdline");
+		return -1;
+	}
+	for (arg = strtok_r(cmdline, " ", &save); arg;
+		 arg = strtok_r(NULL, " ", &save))
+	{
+		if (strncmp(arg, "memmap=", 7) != 0)
+			continue;
+		p = arg + 7;
+		do
+		{
+			p = parse_size(p, &region.size);
+			if (!p)
+				break;
+			if (*p == '$')
+			{
+				p = parse_size(p + 1, &region.start);
+				if (!p)
+					break;
+				if (num < max)
+					regions[num++] = region;
+			}
+			p += strcspn(p, ",");
+		} while (*p++ == ',');
+	}
+	return num;
+}
+
+/* Warn if a region does not lie in reserved memory of /proc/iomem. */
+static void check_reserved(const char *name, const struct mem_region *region)
+{
+	unsigned long long start, end;
+	bool addresses = false;
+	char line[256];
+	FILE *iomem;
+
+	iomem = fopen("/proc/iomem", "r");
+	if (!iomem)
+		return;
+	while (fgets(line, sizeof(line), iomem))
+	{
+		if (sscanf(line, "%llx-%llx", &start, &end) != 2)
+			continue;
+		/* only root sees the addresses */
+		if (end)
+			addresses = true;
+		if (line[0] != ' ' &&
+			(strstr(line, "Reserved") || strstr(line, "reserved")) &&
+			start <= region->start &&
+			region->start + region->size - 1 <= end)
+		{
+			fclose(iomem);
+			return;
+		}
+	}
+	fclose(iomem);
+	if (addresses)
+		fprintf(
+			stderr, "warning: %s [0x%llx-0x%llx] is not reserved memory\n",
+			name, region->start, region->start + region->size - 1);
+}
+
+/* Top-level entry of /proc/iomem */
+struct iomem_range
+{
+	unsigned long long start;
+	/* inclusive */
+	unsigned long long end;
+	bool ram;
+	bool reserved;
+};
+
+/*
+ * Read the top-level entries of /proc/iomem in their order. Returns their
+ * number, -1 if the file cannot be read or only root sees the addresses.
+ */
+static int read_iomem(struct iomem_range *ranges, int max)
+{
+	bool addresses = false;
+	char line[256];
+	int num = 0;
+	FILE *iomem;
+
+	iomem = fopen("/proc/iomem", "r");
+	if (!iomem)
+		return -1;
+	while (num < max && fgets(line, sizeof(line), iomem))
+	{
+		if (line[0] == ' ' ||
+			sscanf(
+				line, "%llx-%llx", &ranges[num].start, &ranges[num].end) != 2)
+			continue;
+		if (ranges[num].end)
+			addresses = true;
+		ranges[num].ram = strstr(line, ": System RAM") != NULL;
+		ranges[num].reserved =
+			strstr(line, ": Reserved") || strstr(line, ": reserved");
+		num++;
+	}
+	fclose(iomem);
+	return addresses ? num : -1;
+}
+
+/*
+ * Whether [start, start + size) is RAM Linux can give up with memmap=, or
+ * already reserved by one of the @c num reservations in @c memmap.
+ */
+static bool range_usable(
+	const struct iomem_range *ranges, int num_ranges,
+	const struct mem_region *memmap, int num_memmap, unsigned long long start,
+	unsigned long long size)
+{
+	unsigned long long next = start, last = start + size - 1;
+	bool usable;
+	int n, m;
+
+	for (n = 0; n < num_ranges && next <= last; n++)
+	{
+		if (ranges[n].start > next || ranges[n].end < next)
+			continue;
+		usable = ranges[n].ram;
+		for (m = 0; m < num_memmap && !usable; m++)
+			usable = ranges[n].reserved &&
+					 memmap[m].start <= ranges[n].end &&
+					 memmap[m].start + memmap[m].size - 1 >= ranges[n].start;
+		if (!usable)
+			return false;
+		next = ranges[n].end + 1;
+		/* the last range of the address space */
+		if (!next)
+			return true;
+	}
+	return next > last;
+}
+
+/*
+ * Set sizing->hv_start for hv_region and rt_region of @c size bytes in
+ * total: --hv-start if given, else the current reservation if the new one
+ * fits there, else the top of the highest System RAM range below
+ * HV_PLACE_BELOW that fits, of any range if none does. Fails if the range
+ * is not usable or /proc/iomem hides the addresses.
+ */
+static int place_hv_region(struct hv_sizing *sizing, unsigned long long size)
+{
+	static struct iomem_range ranges[IOMEM_MAX_ENTRIES];
+	struct mem_region memmap[CMDLINE_MAX_MEMMAP];
+	unsigned long long align = layout_opts.align, start, best = 0;
+	bool best_low = false;
+	int num_ranges, num_memmap, n;
+
+	num_ranges = read_iomem(ranges, IOMEM_MAX_ENTRIES);
+	num_memmap = parse_memmap(memmap, CMDLINE_MAX_MEMMAP);
+	if (num_ranges < 0 || num_memmap < 0)
+	{
+		fprintf(
+			stderr, "cannot read the memory map, run as root or pass "
+					"--hv-start\n");
+		return -1;
+	}
+
+	if (layout_opts.hv_start)
+	{
+		start = align_up(layout_opts.hv_start, align);
+		if (!range_usable(
+				ranges, num_ranges, memmap, num_memmap, start, size))
+		{
+			fprintf(
+				stderr, "[0x%llx-0x%llx] is not in RAM\n", start,
+				start + size - 1);
+			return -1;
+		}
+		sizing->hv_start = start;
+		return 0;
+	}
+
+	if (num_memmap &&
+		range_usable(
+			ranges, num_ranges, memmap, num_memmap, memmap[0].start, size))
+	{
+		sizing->hv_start = memmap[0].start;
+		return 0;
+	}
+
+	for (n = 0; n < num_ranges; n++)
+	{
+		if (!ranges[n].ram || ranges[n].end - ranges[n].start + 1 < size)
+			continue;
+		start = (ranges[n].end + 1 - size) / align * align;
+		if (start < ranges[n].start)
+			continue;
+		/* below HV_PLACE_BELOW wins, then the highest address */
+		if (start + size <= HV_PLACE_BELOW)
+		{
+			if (!best_low || start > best)
+				best = start;
+			best_low = true;
+		}
+		else if (!best_low && start > best)
+			best = start;
+	}
+	if (!best)
+	{
+		fprintf(stderr, "no RAM range fits 0x%llx bytes\n", size);
+		return -1;
+	}
+	sizing->hv_start = best;
+	return 0;
+}
+
+/*
+ * Fill in the regions not given with --hv and --rt from the reservations
+ * on the kernel command line, as made by update-cmdline.sh: the first is
+ * hv_region, the second rt_region. A single reservation is split, with
+ * hv_region getting the size computed by hv_sizing(). With --cma, the
+ * driver allocates them from its CMA area instead.
+ */
+static int discover_regions(void)
+{
+	struct mem_region memmap[CMDLINE_MAX_MEMMAP];
+	struct hv_sizing sizing;
+	unsigned long long hv_size;
+	int num;
+
+	/* the driver sizes hv_region itself, start 0 selects CMA */
+	if (use_cma)
+	{
+		if (!enable_args.rt_region.size)
+			enable_args.rt_region.size =
+				align_up(layout_opts.rt_size, layout_opts.align);
+		return 0;
+	}
+
+	if (!enable_args.hv_region.size || !enable_args.rt_region.size)
+	{
+		num = parse_memmap(memmap, CMDLINE_MAX_MEMMAP);
+		if (num < 0)
+			return -1;
+		if (num == 0)
+		{
+			fprintf(
+				stderr, "no memmap=SIZE$START on the kernel command line, "
+						"run update-cmdline.sh or pass --hv and --rt\n");
+			return -1;
+		}
+		if (num == 1)
+		{
+			if (hv_sizing(&sizing))
+				return -1;
+			hv_size = sizing.hv_size;
+			if (hv_size >= memmap[0].size)
+			{
+				fprintf(
+					stderr, "reservation of 0x%llx bytes too small, need "
+							"more than 0x%llx for the hypervisor\n",
+					memmap[0].size, hv_size);
+				return -1;
+			}
+			memmap[1].start = memmap[0].start + hv_size;
+			memmap[1].size = memmap[0].size - hv_size;
+			memmap[0].size = hv_size;
+		}
+		if (!enable_args.hv_region.size)
+			enable_args.hv_region = memmap[0];
+		if (!enable_args.rt_region.size)
+			enable_args.rt_region = memmap[1];
+	}
+
+	check_reserved("hv_region", &enable_args.hv_region);
+	check_reserved("rt_region", &enable_args.rt_region);
+	return 0;
+}
+
+/* Parse a list like 0,2-3 into rt_cpu_set. */
+static int parse_cpu_list(const char *list)
+{
+	unsigned long first, last, cpu;
+	const char *p = list;
+	char *end;
+
+	do
+	{
+		first = strtoul(p, &end, 10);
+		if (end == p)
+			return -1;
+		last = first;
+		if (*end == '-')
+		{
+			p = end + 1;
+			last = strtoul(p, &end, 10);
+			if (end == p)
+				return -1;
+		}
+		if (first > last || last >= RT_MAX_CPUS)
+			return -1;
+		for (cpu = first; cpu <= last; cpu++)
+			rt_cpu_set[cpu / BITS_PER_ULONG] |= 1UL << (cpu % BITS_PER_ULONG);
+		p = end + 1;
+	} while (*end == ',');
+
+	return *end ? -1 : 0;
+}
+
+/*
+ * Options of the layout command, also accepted by enable and trace for
+ * splitting a single reservation. Returns false for other options.
+ */
+static bool parse_layout_arg(int argc, char *argv[], int *n)
+{
+	unsigned long long *value;
+	const char *end;
+
+	if (*n + 1 >= argc)
+		return false;
+	if (strcmp(argv[*n], "--huge") == 0)
+	{
+		++*n;
+		if (strcmp(argv[*n], "2M") == 0)
+		{
+			enable_args.flags |= JAILHOUSE_ENABLE_ALIGN_2M;
+			layout_opts.align = 2ULL << 20;
+		}
+		else if (strcmp(argv[*n], "1G") == 0)
+		{
+			enable_args.flags |= JAILHOUSE_ENABLE_ALIGN_1G;
+			layout_opts.align = 1ULL << 30;
+		}
+		else
+			help(argv[0], 1);
+		return true;
+	}
+	if (strcmp(argv[*n], "--firmware") == 0)
+	{
+		layout_opts.firmware = argv[++*n];
+		return true;
+	}
+
+	if (strcmp(argv[*n], "--hv-start") == 0)
+		value = &layout_opts.hv_start;
+	else if (strcmp(argv[*n], "--rt-size") == 0)
+		value = &layout_opts.rt_size;
+	else if (strcmp(argv[*n], "--pool-size") == 0)
+		value = &layout_opts.pool_size;
+	else
+		return false;
+	end = parse_size(argv[++*n], value);
+	if (!end || *end)
+		help(argv[0], 1);
+	return true;
+}
+
+static void parse_enable_args(int argc, char *argv[])
+{
+	int n;
+
+	for (n = 2; n < argc; n++)
+	{
+		if (strcmp(argv[n], "--reload") == 0)
+		{
+			enable_args.flags |= JAILHOUSE_ENABLE_RELOAD;
+		}
+		else if (strcmp(argv[n], "--async") == 0)
+		{
+			enable_args.flags |= JAILHOUSE_ENABLE_ASYNC;
+		}
+		else if (strcmp(argv[n], "--hv") == 0 && n + 1 < argc)
+		{
+			if (parse_region(argv[++n], &enable_args.hv_region))
+				help(argv[0], 1);
+		}
+		else if (strcmp(argv[n], "--rt") == 0 && n + 1 < argc)
+		{
+			if (parse_region(argv[++n], &enable_args.rt_region))
+				help(argv[0], 1);
+		}
+		else if (strcmp(argv[n], "--cma") == 0)
+		{
+			use_cma = true;
+		}
+		else if (strcmp(argv[n], "--rt-cpus") == 0 && n + 1 < argc)
+		{
+			enable_args.rt_cpus = strtoul(argv[++n], NULL, 0);
+			if (!enable_args.rt_cpus)
+				help(argv[0], 1);
+		}
+		else if (strcmp(argv[n], "--rt-cpu-list") == 0 && n + 1 < argc)
+		{
+			if (parse_cpu_list(argv[++n]))
+				help(argv[0], 1);
+			enable_args.rt_cpu_set = (unsigned long)rt_cpu_set;
+			enable_args.rt_cpu_set_size = sizeof(rt_cpu_set);
+		}
+		else if (strcmp(argv[n], "--isolate") == 0 && n + 1 < argc)
+		{
+			n++;
+			if (strcmp(argv[n], "smt") == 0)
+				enable_args.flags |= JAILHOUSE_ENABLE_RT_ISOLATE_SMT;
+			else if (strcmp(argv[n], "llc") == 0)
+				enable_args.flags |= JAILHOUSE_ENABLE_RT_ISOLATE_LLC;
+			else
+				help(argv[0], 1);
+		}
+		else if (!parse_layout_arg(argc, argv, &n))
+			help(argv[0], 1);
+	}
+
+	if (discover_regions())
+		exit(1);
+}
+
+/*
+ * Print the hypervisor and RT regions to reserve on this host, as
+ * "SIZE START" lines with --memmap.
+ */
+static int layout_cmd(int argc, char *argv[])
+{
+	struct hv_sizing sizing;
+	unsigned long long rt_size;
+	bool memmap = false;
+	int n;
+
+	for (n = 2; n < argc; n++)
+	{
+		if (strcmp(argv[n], "--memmap") == 0)
+			memmap = true;
+		else if (!parse_layout_arg(argc, argv, &n))
+			help(argv[0], 1);
+	}
+
+	if (hv_sizing(&sizing))
+		return -1;
+	rt_size = align_up(layout_opts.rt_size, layout_opts.align);
+	if (place_hv_region(&sizing, sizing.hv_size + rt_size))
+		return -1;
+
+	if (memmap)
+	{
+		printf("0x%llx 0x%llx\n", sizing.hv_size, sizing.hv_start);
+		printf("0x%llx 0x%llx\n", rt_size, sizing.hv_start + sizing.hv_size);
+		return 0;
+	}
+
+	printf(
+		"image:      %s (features 0x%x)\n"
+		"host:       %u CPUs, %u NUMA nodes, up to %u memory regions\n"
+		"hypervisor: core 0x%lx, per-CPU %u x 0x%lx, config 0x%lx, "
+		"shared 0x%lx,\n"
+		"            page pool 0x%llx\n"
+		"hv_region:  0x%llx bytes at 0x%llx\n"
+		"rt_region:  0x%llx bytes at 0x%llx\n",
+		sizing.firmware, sizing.params.features, sizing.params.max_cpus,
+		sizing.nodes, sizing.regions, sizing.params.core_size,
+		sizing.params.max_cpus, sizing.params.percpu_size,
+		sizing.params.config_size,
+		sizing.layout.end -
+			jailhouse_layout_align(
+				sizing.layout.config_offset + sizing.params.config_size,
+				sizing.params.page_size),
+		layout_opts.pool_size, sizing.hv_size, sizing.hv_start, rt_size,
+		sizing.hv_start + sizing.hv_size);
+	return 0;
+}
+
 static int open_dev()
 {
 	int fd;
@@ -67,6 +935,718 @@ static int open_dev()
 	return fd;
 }
 
+static void bench_print_bucket(unsigned int bucket)
+{
+	static const char *const units[] = {"", "K", "M", "G"};
+	unsigned int lo = bucket, hi = bucket + 1;
+	char range[32];
+
+	snprintf(
+		range, sizeof(range), "[%u%s, %u%s)", 1U << (lo % 10),
+		units[lo / 10], 1U << (hi % 10), units[hi / 10]);
+	printf("  %-14s", range);
+}
+
+static void bench_print_cpu(
+	unsigned int cpu, const struct jailhouse_bench_cpu *res,
+	unsigned long long tsc_khz)
+{
+	unsigned long long peak = 0;
+	unsigned int n, width;
+
+	printf(
+		"CPU %u: min %llu, avg %llu, p99 %llu, max %llu cycles", cpu,
+		(unsigned long long)res->min, (unsigned long long)res->avg,
+		(unsigned long long)res->p99, (unsigned long long)res->max);
+	if (tsc_khz)
+		printf(
+			" (avg %.0f ns)", (double)res->avg * 1000000.0 / (double)tsc_khz);
+	printf("\n");
+
+	for (n = 0; n < JAILHOUSE_BENCH_BUCKETS; n++)
+		if (res->histogram[n] > peak)
+			peak = res->histogram[n];
+	for (n = 0; n < JAILHOUSE_BENCH_BUCKETS; n++)
+	{
+		if (!res->histogram[n])
+			continue;
+		bench_print_bucket(n);
+		width = res->histogram[n] * BENCH_BAR_WIDTH / peak;
+		printf(
+			"%10llu %.*s\n", (unsigned long long)res->histogram[n],
+			width ? width : 1,
+			"########################################");
+	}
+}
+
+/*
+ * Time null hypercalls on each CPU running under the hypervisor and print
+ * the latency distribution.
+ */
+static int bench_hypercall(int argc, char *argv[])
+{
+	struct jailhouse_bench_hypercall bench;
+	struct jailhouse_bench_cpu *results;
+	unsigned int iterations = BENCH_DEFAULT_ITERATIONS, cpu;
+	int n, fd, err;
+
+	for (n = 3; n < argc; n++)
+	{
+		if (strcmp(argv[n], "--iterations") == 0 && n + 1 < argc)
+			iterations = strtoul(argv[++n], NULL, 0);
+		else
+			help(argv[0], 1);
+	}
+
+	results = calloc(BENCH_MAX_CPUS, sizeof(*results));
+	if (!results)
+	{
+		perror("calloc");
+		return -1;
+	}
+	bench.iterations = iterations;
+	bench.num_cpus = BENCH_MAX_CPUS;
+	bench.cpus = (unsigned long)results;
+	bench.tsc_khz = 0;
+
+	fd = open_dev();
+	err = ioctl(fd, JAILHOUSE_BENCH_HYPERCALL, &bench);
+	close(fd);
+	if (err)
+	{
+		perror("JAILHOUSE_BENCH_HYPERCALL");
+		free(results);
+		return err;
+	}
+
+	printf("Null hypercall latency, %u calls per CPU", iterations);
+	if (bench.tsc_khz)
+		printf(", TSC at %llu kHz", (unsigned long long)bench.tsc_khz);
+	printf(":\n");
+	for (cpu = 0; cpu < bench.num_cpus; cpu++)
+		if (results[cpu].samples)
+			bench_print_cpu(cpu, &results[cpu], bench.tsc_khz);
+
+	free(results);
+	return 0;
+}
+
+static int load_rt(int argc, char *argv[])
+{
+	struct jailhouse_load_rt load;
+	bool entry_set = false;
+	int n, fd, err;
+	char *end;
+
+	if (argc < 3)
+		help(argv[0], 1);
+
+	memset(&load, 0, sizeof(load));
+	for (n = 3; n < argc; n++)
+	{
+		if (n + 1 >= argc)
+			help(argv[0], 1);
+		if (strcmp(argv[n], "--offset") == 0)
+			load.rt_offset = strtoull(argv[++n], &end, 0);
+		else if (strcmp(argv[n], "--entry") == 0)
+		{
+			load.entry = strtoull(argv[++n], &end, 0);
+			entry_set = true;
+		}
+		else if (strcmp(argv[n], "--mem-size") == 0)
+			load.mem_size = strtoull(argv[++n], &end, 0);
+		else if (strcmp(argv[n], "--file-offset") == 0)
+			load.file_offset = strtoull(argv[++n], &end, 0);
+		else
+			help(argv[0], 1);
+		if (*end)
+			help(argv[0], 1);
+	}
+	if (!entry_set)
+		load.entry = load.rt_offset;
+
+	load.fd = open(argv[2], O_RDONLY);
+	if (load.fd < 0)
+	{
+		perror(argv[2]);
+		return -1;
+	}
+
+	fd = open_dev();
+	err = ioctl(fd, JAILHOUSE_LOAD_RT, &load);
+	if (err)
+		perror("JAILHOUSE_LOAD_RT");
+	else
+		printf(
+			"Loaded %llu bytes in %.3f ms (%.1f MB/s), entry at 0x%llx\n",
+			(unsigned long long)load.bytes, load.nsec / 1e6,
+			load.nsec ? load.bytes * 1e3 / load.nsec : 0.0,
+			(unsigned long long)load.entry_phys);
+	close(fd);
+	close(load.fd);
+	return err;
+}
+
+static int cpu_cmd(int argc, char *argv[])
+{
+	struct jailhouse_cpu_assign assign;
+	unsigned long cpu;
+	int fd, err;
+	char *end;
+
+	if (argc != 5 || strcmp(argv[2], "assign") != 0)
+		help(argv[0], 1);
+
+	cpu = strtoul(argv[3], &end, 10);
+	if (*end || end == argv[3] || cpu >= RT_MAX_CPUS)
+		help(argv[0], 1);
+	assign.cpu = cpu;
+	if (strcmp(argv[4], "linux") == 0)
+		assign.target = JAILHOUSE_CPU_LINUX;
+	else if (strcmp(argv[4], "rt") == 0)
+		assign.target = JAILHOUSE_CPU_RT;
+	else
+		help(argv[0], 1);
+
+	fd = open_dev();
+	err = ioctl(fd, JAILHOUSE_CPU_ASSIGN, &assign);
+	if (err)
+		perror("JAILHOUSE_CPU_ASSIGN");
+	close(fd);
+	return err;
+}
+
+static int balloon_cmd(int argc, char *argv[])
+{
+	struct jailhouse_balloon balloon;
+	unsigned long long value;
+	const char *end;
+	int fd, err;
+
+	if (argc != 4)
+		help(argv[0], 1);
+
+	memset(&balloon, 0, sizeof(balloon));
+	end = parse_size(argv[3], &value);
+	if (!end || *end)
+		help(argv[0], 1);
+	if (strcmp(argv[2], "inflate") == 0)
+	{
+		balloon.op = JAILHOUSE_BALLOON_INFLATE;
+		balloon.size = align_up(value, JAILHOUSE_BALLOON_ALIGN);
+	}
+	else if (strcmp(argv[2], "deflate") == 0)
+	{
+		balloon.op = JAILHOUSE_BALLOON_DEFLATE;
+		balloon.start = value;
+	}
+	else
+		help(argv[0], 1);
+
+	fd = open_dev();
+	err = ioctl(fd, JAILHOUSE_BALLOON, &balloon);
+	if (err)
+		perror("JAILHOUSE_BALLOON");
+	else
+		printf(
+			"%s [0x%llx-0x%llx], RT partition holds %llu MiB extra\n",
+			balloon.op == JAILHOUSE_BALLOON_INFLATE ? "Donated" : "Reclaimed",
+			(unsigned long long)balloon.start,
+			(unsigned long long)(balloon.start + balloon.size - 1),
+			(unsigned long long)balloon.total >> 20);
+	close(fd);
+	return err;
+}
+
+/*
+ * Write the console content from pos up to the current tail to stdout,
+ * straight from the mapping. Returns the new position.
+ */
+static unsigned long long console_dump(
+	const struct jailhouse_console *console, const char *content,
+	unsigned long long pos)
+{
+	unsigned long long tail, start, len;
+	ssize_t written;
+
+	tail = __atomic_load_n(&console->tail, __ATOMIC_ACQUIRE);
+	if (tail - pos > console->size)
+	{
+		fprintf(
+			stderr, "[jailhouse: %llu bytes of console output lost]\n",
+			tail - pos - console->size);
+		pos = tail - console->size;
+	}
+
+	start = pos;
+	while (pos < tail)
+	{
+		len = console->size - pos % console->size;
+		if (len > tail - pos)
+			len = tail - pos;
+		written = write(1, content + pos % console->size, len);
+		if (written <= 0)
+			break;
+		pos += written;
+	}
+
+	/* The hypervisor may have overwritten what we were copying. */
+	tail = __atomic_load_n(&console->tail, __ATOMIC_ACQUIRE);
+	if (tail - start > console->size)
+		fprintf(stderr, "[jailhouse: console output overrun]\n");
+
+	return pos;
+}
+
+static int console_cmd(int argc, char *argv[])
+{
+	const struct jailhouse_console *console;
+	unsigned long long pos = 0;
+	struct pollfd pfd;
+	bool follow = false;
+	size_t map_size;
+	void *map;
+	int n, fd;
+
+	for (n = 2; n < argc; n++)
+	{
+		if (strcmp(argv[n], "--follow") == 0 || strcmp(argv[n], "-f") == 0)
+			follow = true;
+		else
+			help(argv[0], 1);
+	}
+
+	fd = open(JAILHOUSE_CONSOLE_DEVICE, O_RDONLY);
+	if (fd < 0)
+	{
+		perror("opening " JAILHOUSE_CONSOLE_DEVICE);
+		return -1;
+	}
+
+	/* the control page tells the size of the whole area */
+	map = mmap(NULL, JAILHOUSE_CONSOLE_CONTENT, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		goto error;
+	map_size = JAILHOUSE_CONSOLE_CONTENT +
+			   ((const struct jailhouse_console *)map)->size;
+	munmap(map, JAILHOUSE_CONSOLE_CONTENT);
+	map = mmap(NULL, map_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		goto error;
+	console = map;
+
+	pos = console_dump(console, map + JAILHOUSE_CONSOLE_CONTENT, pos);
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	while (follow)
+	{
+		if (poll(&pfd, 1, -1) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			perror("poll");
+			break;
+		}
+		pos = console_dump(console, map + JAILHOUSE_CONSOLE_CONTENT, pos);
+		if (pfd.revents & POLLHUP)
+		{
+			fprintf(stderr, "[jailhouse: hypervisor disabled]\n");
+			break;
+		}
+	}
+
+	munmap(map, map_size);
+	close(fd);
+	return 0;
+
+error:
+	perror("mapping " JAILHOUSE_CONSOLE_DEVICE);
+	close(fd);
+	return -1;
+}
+
+static const char *const phase_names[JAILHOUSE_NUM_PHASES] = {
+	[JAILHOUSE_PHASE_ENABLE] = "enable",
+	[JAILHOUSE_PHASE_FW_LOAD] = "fw_load",
+	[JAILHOUSE_PHASE_MEM_REGIONS] = "mem_regions",
+	[JAILHOUSE_PHASE_IOREMAP] = "ioremap",
+	[JAILHOUSE_PHASE_COPY] = "copy",
+	[JAILHOUSE_PHASE_CONFIG] = "config",
+	[JAILHOUSE_PHASE_FLUSH_ICACHE] = "flush_icache",
+	[JAILHOUSE_PHASE_ENTER] = "enter",
+	[JAILHOUSE_PHASE_DISABLE] = "disable",
+	[JAILHOUSE_PHASE_LEAVE] = "leave",
+};
+
+/*
+ * Wait until no enable is running, e.g. one started with enable --async,
+ * and print the result of each of its phases. Fails if the enable did.
+ */
+static int wait_cmd(int argc, char *argv[])
+{
+	struct jailhouse_enable_status status;
+	struct pollfd pfd;
+	int timeout = -1;
+	int n, fd, ret;
+
+	for (n = 2; n < argc; n++)
+	{
+		if (strcmp(argv[n], "--timeout") == 0 && n + 1 < argc)
+			timeout = strtoul(argv[++n], NULL, 0) * 1000;
+		else
+			help(argv[0], 1);
+	}
+
+	fd = open_dev();
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	do
+		ret = poll(&pfd, 1, timeout);
+	while (ret < 0 && errno == EINTR);
+	if (ret <= 0)
+	{
+		if (ret < 0)
+			perror("poll");
+		else
+			fprintf(stderr, "timed out waiting for the enable\n");
+		close(fd);
+		return -1;
+	}
+	ret = ioctl(fd, JAILHOUSE_ENABLE_STATUS, &status);
+	close(fd);
+	if (ret)
+	{
+		perror("JAILHOUSE_ENABLE_STATUS");
+		return -1;
+	}
+
+	if (status.state == JAILHOUSE_ENABLE_IDLE)
+	{
+		printf("no enable since the driver was loaded\n");
+		return 0;
+	}
+	for (n = 0; n < JAILHOUSE_NUM_PHASES; n++)
+		if (status.phase_nsec[n])
+			printf(
+				"%-13s %10.3f ms  %s\n", phase_names[n],
+				status.phase_nsec[n] / 1e6,
+				status.phase_result[n] ? strerror(-status.phase_result[n])
+									   : "ok");
+	if (status.result)
+	{
+		fprintf(
+			stderr, "enable #%u failed in %s: %s\n", status.seq,
+			status.phase < JAILHOUSE_NUM_PHASES ? phase_names[status.phase]
+												: "?",
+			strerror(-status.result));
+		return -1;
+	}
+	return 0;
+}
+
+struct trace_span
+{
+	double begin, end;
+	int err;
+	/* begin and end event recorded */
+	bool seen, ended;
+};
+
+struct trace_phase
+{
+	char name[32];
+	struct trace_span span;
+};
+
+struct trace_result
+{
+	struct trace_phase phases[TRACE_MAX_PHASES];
+	unsigned int num_phases;
+	/* indexed by CPU number, for the enter and the leave operation */
+	struct trace_span *cpu_enter, *cpu_leave;
+	unsigned int max_cpu;
+};
+
+static int write_file(const char *dir, const char *name, const char *value)
+{
+	char path[PATH_MAX];
+	int fd, err = 0;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	fd = open(path, O_WRONLY | O_TRUNC);
+	if (fd < 0)
+	{
+		perror(path);
+		return -1;
+	}
+	if (write(fd, value, strlen(value)) < 0)
+	{
+		perror(path);
+		err = -1;
+	}
+	close(fd);
+	return err;
+}
+
+static const char *find_tracefs(void)
+{
+	if (access(TRACEFS_PATH "/events/jailhouse", F_OK) == 0)
+		return TRACEFS_PATH;
+	if (access(DEBUGFS_TRACING_PATH "/events/jailhouse", F_OK) == 0)
+		return DEBUGFS_TRACING_PATH;
+	fprintf(
+		stderr, "jailhouse trace events not found, is tracefs mounted and "
+				"the driver loaded?\n");
+	return NULL;
+}
+
+static struct trace_span *
+trace_phase_span(struct trace_result *res, const char *name)
+{
+	unsigned int n;
+
+	for (n = 0; n < res->num_phases; n++)
+		if (strcmp(res->phases[n].name, name) == 0)
+			return &res->phases[n].span;
+	if (res->num_phases == TRACE_MAX_PHASES)
+		return NULL;
+	snprintf(
+		res->phases[n].name, sizeof(res->phases[n].name), "%s", name);
+	res->num_phases++;
+	return &res->phases[n].span;
+}
+
+static struct trace_span *
+trace_cpu_span(struct trace_result *res, unsigned int cpu, const char *op)
+{
+	if (cpu >= TRACE_MAX_CPUS)
+		return NULL;
+	if (cpu > res->max_cpu)
+		res->max_cpu = cpu;
+	if (strcmp(op, "enter") == 0)
+		return &res->cpu_enter[cpu];
+	if (strcmp(op, "leave") == 0)
+		return &res->cpu_leave[cpu];
+	return NULL;
+}
+
+/*
+ * Parse one line of the tracefs "trace" file, e.g.
+ *   jailhouse-42 [003] ..... 123.456789: jailhouse_cpu_end: cpu=3 op=enter err=0
+ */
+static void trace_parse_line(struct trace_result *res, const char *line)
+{
+	struct trace_span *span;
+	const char *event, *ts;
+	char name[32], op[32];
+	unsigned int cpu;
+	double stamp;
+	int err = 0;
+
+	event = strstr(line, ": jailhouse_");
+	if (!event)
+		return;
+	for (ts = event; ts > line && ts[-1] != ' '; ts--)
+		;
+	if (sscanf(ts, "%lf", &stamp) != 1)
+		return;
+	event += 2;
+
+	if (sscanf(event, "jailhouse_phase_begin: phase=%31s", name) == 1)
+	{
+		span = trace_phase_span(res, name);
+		if (span)
+		{
+			span->begin = stamp;
+			span->seen = true;
+		}
+	}
+	else if (
+		sscanf(event, "jailhouse_phase_end: phase=%31s err=%d", name, &err) ==
+		2)
+	{
+		span = trace_phase_span(res, name);
+		if (span)
+		{
+			span->end = stamp;
+			span->err = err;
+			span->ended = true;
+		}
+	}
+	else if (
+		sscanf(event, "jailhouse_cpu_begin: cpu=%u op=%31s", &cpu, op) == 2)
+	{
+		span = trace_cpu_span(res, cpu, op);
+		if (span)
+		{
+			span->begin = stamp;
+			span->seen = true;
+		}
+	}
+	else if (
+		sscanf(
+			event, "jailhouse_cpu_end: cpu=%u op=%31s err=%d", &cpu, op,
+			&err) == 3)
+	{
+		span = trace_cpu_span(res, cpu, op);
+		if (span)
+		{
+			span->end = stamp;
+			span->err = err;
+			span->ended = true;
+		}
+	}
+}
+
+/*
+ * Time from @c from to @c to in us, -1 if an event is missing or they are
+ * out of order, e.g. after a CPU timed out or the trace buffer overflowed.
+ */
+static double trace_usec(double from, double to, bool complete)
+{
+	if (!complete || to < from)
+		return -1;
+	return (to - from) * 1e6;
+}
+
+static double trace_span_usec(const struct trace_span *span)
+{
+	return trace_usec(span->begin, span->end, span->seen && span->ended);
+}
+
+static void trace_print_cpus(
+	const char *title, const struct trace_span *cpus, unsigned int max_cpu,
+	const struct trace_span *rendezvous)
+{
+	double min = 0, max = 0, sum = 0;
+	unsigned int cpu, n = 0;
+
+	printf("\nPer-CPU %s (us):\n", title);
+	printf("  %-5s %12s %12s %6s\n", "CPU", "dispatch", "duration", "err");
+	for (cpu = 0; cpu <= max_cpu; cpu++)
+	{
+		const struct trace_span *span = &cpus[cpu];
+		double duration;
+
+		if (!span->seen)
+			continue;
+		duration = trace_span_usec(span);
+		printf(
+			"  %-5u %12.3f %12.3f %6d\n", cpu,
+			trace_usec(
+				rendezvous ? rendezvous->begin : 0, span->begin,
+				rendezvous && rendezvous->seen),
+			duration, span->err);
+		/* incomplete spans print as -1 and are left out */
+		if (duration < 0)
+			continue;
+		if (n == 0 || duration < min)
+			min = duration;
+		if (n == 0 || duration > max)
+			max = duration;
+		sum += duration;
+		n++;
+	}
+	if (n)
+		printf(
+			"  %u CPUs: min %.3f avg %.3f max %.3f\n", n, min, sum / n, max);
+}
+
+static void trace_print(struct trace_result *res)
+{
+	struct trace_span *enter = NULL, *leave = NULL;
+	unsigned int n;
+
+	printf("%-14s %14s %6s\n", "Phase", "duration (us)", "err");
+	for (n = 0; n < res->num_phases; n++)
+	{
+		struct trace_phase *phase = &res->phases[n];
+
+		if (!phase->span.seen)
+			continue;
+		if (strcmp(phase->name, "enter") == 0)
+			enter = &phase->span;
+		else if (strcmp(phase->name, "leave") == 0)
+			leave = &phase->span;
+		printf(
+			"%-14s %14.3f %6d\n", phase->name,
+			trace_span_usec(&phase->span), phase->span.err);
+	}
+
+	trace_print_cpus("hypervisor entry", res->cpu_enter, res->max_cpu, enter);
+	trace_print_cpus("hypervisor exit", res->cpu_leave, res->max_cpu, leave);
+}
+
+/*
+ * Record one enable/disable cycle through the jailhouse trace events and
+ * print the latency of each phase and of each CPU's entry and exit.
+ */
+static int trace_cycle(void)
+{
+	struct trace_result res;
+	const char *tracefs;
+	char path[PATH_MAX];
+	char line[512];
+	int fd, err;
+	FILE *trace;
+
+	tracefs = find_tracefs();
+	if (!tracefs)
+		return -1;
+
+	memset(&res, 0, sizeof(res));
+	res.cpu_enter = calloc(TRACE_MAX_CPUS, sizeof(*res.cpu_enter));
+	res.cpu_leave = calloc(TRACE_MAX_CPUS, sizeof(*res.cpu_leave));
+	err = -1;
+	if (!res.cpu_enter || !res.cpu_leave)
+	{
+		perror("calloc");
+		goto out;
+	}
+
+	/* per-CPU timestamps are only comparable with a global clock */
+	if (write_file(tracefs, "tracing_on", "0") ||
+		write_file(tracefs, "trace", "") ||
+		write_file(tracefs, "trace_clock", "global") ||
+		write_file(tracefs, "events/jailhouse/enable", "1") ||
+		write_file(tracefs, "tracing_on", "1"))
+		goto out;
+
+	fd = open_dev();
+	err = ioctl(fd, JAILHOUSE_ENABLE, &enable_args);
+	if (err)
+		perror("JAILHOUSE_ENABLE");
+	else
+	{
+		err = ioctl(fd, JAILHOUSE_DISABLE);
+		if (err)
+			perror("JAILHOUSE_DISABLE");
+	}
+	close(fd);
+
+	write_file(tracefs, "tracing_on", "0");
+	write_file(tracefs, "events/jailhouse/enable", "0");
+
+	snprintf(path, sizeof(path), "%s/trace", tracefs);
+	trace = fopen(path, "r");
+	if (!trace)
+	{
+		perror(path);
+		err = -1;
+		goto out;
+	}
+	while (fgets(line, sizeof(line), trace))
+		trace_parse_line(&res, line);
+	fclose(trace);
+
+	trace_print(&res);
+
+out:
+	free(res.cpu_enter);
+	free(res.cpu_leave);
+	return err;
+}
+
 int main(int argc, char *argv[])
 {
 	int fd;
@@ -77,6 +1657,8 @@ int main(int argc, char *argv[])
 
 	if (strcmp(argv[1], "enable") == 0)
 	{
+		parse_enable_args(argc, argv);
+
 		fd = open_dev();
 		err = ioctl(fd, JAILHOUSE_ENABLE, &enable_args);
 		if (err)
@@ -91,6 +1673,44 @@ int main(int argc, char *argv[])
 			perror("JAILHOUSE_DISABLE");
 		close(fd);
 	}
+	else if (strcmp(argv[1], "wait") == 0)
+	{
+		err = wait_cmd(argc, argv);
+	}
+	else if (strcmp(argv[1], "trace") == 0)
+	{
+		parse_enable_args(argc, argv);
+		/* the cycle has to see the enable through */
+		if (enable_args.flags & JAILHOUSE_ENABLE_ASYNC)
+			help(argv[0], 1);
+		err = trace_cycle();
+	}
+	else if (
+		strcmp(argv[1], "bench") == 0 && argc > 2 &&
+		strcmp(argv[2], "hypercall") == 0)
+	{
+		err = bench_hypercall(argc, argv);
+	}
+	else if (strcmp(argv[1], "console") == 0)
+	{
+		err = console_cmd(argc, argv);
+	}
+	else if (strcmp(argv[1], "load-rt") == 0)
+	{
+		err = load_rt(argc, argv);
+	}
+	else if (strcmp(argv[1], "cpu") == 0)
+	{
+		err = cpu_cmd(argc, argv);
+	}
+	else if (strcmp(argv[1], "balloon") == 0)
+	{
+		err = balloon_cmd(argc, argv);
+	}
+	else if (strcmp(argv[1], "layout") == 0)
+	{
+		err = layout_cmd(argc, argv);
+	}
 	else if (strcmp(argv[1], "--version") == 0)
 	{
 		printf("Jailhouse management tool %s\n", JAILHOUSE_VERSION);
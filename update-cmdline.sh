@@ -1,4 +1,25 @@
 # Update grub config
-cmdline='memmap=0x10000000\\\\\\$0x3a000000'
+#
+# Usage: update-cmdline.sh [LAYOUT-OPTIONS]
+#
+# Reserves the hypervisor and RT memory regions used by tools/jailhouse.
+# `jailhouse layout` sizes them for the CPUs and memory map of this host and
+# for the hypervisor image, see `jailhouse --help` for its options, e.g.
+# --huge 2M|1G. It places them in the current reservation if they still fit,
+# else at the top of free RAM, which needs the addresses of /proc/iomem.
+# `jailhouse enable` finds the regions on the kernel command line. Rerun
+# after changing the image or the number of CPUs.
+jailhouse="$(dirname "$0")/tools/jailhouse"
+
+layout=$(sudo "$jailhouse" layout --memmap "$@") || exit 1
+
+memmap=
+while read -r size start; do
+	memmap="$memmap${memmap:+,}$size"'\\\\\\$'"$start"
+done <<EOT
+$layout
+EOT
+
+cmdline="memmap=$memmap"
 sudo sed -i "s/GRUB_CMDLINE_LINUX=.*/GRUB_CMDLINE_LINUX=$cmdline/" /etc/default/grub
 echo "Appended kernel cmdline: $cmdline, see '/etc/default/grub'"